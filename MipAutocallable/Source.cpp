@@ -2,7 +2,12 @@
 #include <iostream>
 #include <ql/quantlib.hpp>
 #include <marketdata.hpp>
+#include <marketsnapshot.hpp>
+#include <incrementaldiscountcurve.hpp>
 #include <autocallablesimulation.hpp>
+#include <autocallableportfolio.hpp>
+#include <termsheetreader.hpp>
+#include <allocationcounter.hpp>
 
 #ifdef BOOST_MSVC
 #  include <ql/auto_link.hpp>
@@ -12,7 +17,7 @@ using namespace QuantLib;
 
 // Compute the price of an Autocallable Investment Certificate
 
-int main(int, char*[]) {
+int main(int argc, char* argv[]) {
 
 	try {
 
@@ -38,32 +43,216 @@ int main(int, char*[]) {
 		boost::shared_ptr<Quote> underlying(new SimpleQuote(15.35));		
 
 		//discounting curve, dividend curve and volatility term structure
-		auto OISTermStructure = MarketData::builddiscountingcurve(settlementDate, fixingDays);
-		auto qTermStructure = MarketData::builddividendcurve(settlementDate, fixingDays, OISTermStructure);
-		auto varTS = MarketData::buildblackvariancesurface(settlementDate, calendar);
+		//are read from the snapshot saved by a previous run while the market
+		//quotes are unchanged; the adjoint sensitivities and the ticks move
+		//the quotes, so they bootstrap live curves
+		bool sensitivities = argc > 1 && std::string(argv[1]) == "--sensitivities";
+		bool ticks = argc > 1 && std::string(argv[1]) == "--ticks";
+		std::vector<boost::shared_ptr<SimpleQuote> > OISQuotes, bondQuotes;
+		boost::shared_ptr<YieldTermStructure> OISTermStructure, qTermStructure, bondTermStructure;
+		boost::shared_ptr<FlatBlackVarianceSurface> varTS;
+		if (sensitivities || ticks) {
+			OISTermStructure = MarketData::builddiscountingcurve(settlementDate, fixingDays, &OISQuotes);
+			qTermStructure = MarketData::builddividendcurve(settlementDate, fixingDays, OISTermStructure);
+			varTS = MarketData::buildblackvariancesurface(settlementDate, calendar);
+			bondTermStructure = MarketData::buildbonddiscountingurve(settlementDate, fixingDays, &bondQuotes);
+		} else {
+			MarketSnapshot snapshot = MarketSnapshot::cached("marketdata.snapshot",
+				settlementDate, fixingDays, calendar);
+			OISTermStructure = snapshot.discountingCurve();
+			qTermStructure = snapshot.dividendCurve();
+			varTS = snapshot.blackVarianceSurface();
+			bondTermStructure = snapshot.bondDiscountingCurve();
+		}
 		Volatility sigma = varTS->blackVol(optionExpiryDate, strike);
 		sigma = 0.18;
 		const boost::shared_ptr<BlackVolTermStructure> volatility(new BlackConstantVol(settlementDate, calendar, sigma, dayCount));
 
-		//bond discounting curve
-		auto bondTermStructure = MarketData::buildbonddiscountingurve(settlementDate, fixingDays);
-		
 		//Price calculation via Montecarlo simulation
-		AutocallableSimulation autocall(underlying, qTermStructure, bondTermStructure, OISTermStructure, volatility, maturity, strike, settlementDate);
+		AutocallableSimulation autocall(underlying, qTermStructure, bondTermStructure, OISTermStructure, volatility, maturity, strike,
+			settlementDate, varTS);
 		Size nTimeSteps = 1500;
 		Size nSamples = 50000;
 
+		//micro-benchmark of the path pricer, on Black&Scholes paths
+		if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+			autocall.benchmarkPricer(nTimeSteps, 1000, 'B');
+			return 0;
+		}
+
+		//price, delta, gamma and vega in one Black&Scholes run
+		if (argc > 1 && std::string(argv[1]) == "--greeks") {
+			AutocallableSettings settings;
+			settings.observationGrid = true;
+			autocall.computeGreeks(0, nSamples, settings);
+			return 0;
+		}
+
+		//finite-difference check of the gradient behind the Greeks
+		if (argc > 1 && std::string(argv[1]) == "--check-greeks") {
+			autocall.checkGreeks(1000);
+			return 0;
+		}
+
+		//convergence of the quadratic-exponential Heston scheme: prices on
+		//16, 200 and 1600 steps, against full truncation Euler on 1600 steps
+		if (argc > 1 && std::string(argv[1]) == "--check-qe") {
+			AutocallableSettings settings;
+			settings.pathKernel = true;
+			Size steps[] = { 16, 200, 1600 };
+			for (Size i = 0; i < 3; i++) {
+				std::cout << "\nHeston QE, " << steps[i] << " passi" << std::endl;
+				autocall.compute(steps[i], nSamples, 'H', settings);
+			}
+			settings.hestonScheme = FullTruncationScheme;
+			std::cout << "\nHeston Euler, 1600 passi" << std::endl;
+			autocall.compute(1600, nSamples, 'H', settings);
+			return 0;
+		}
+
+		//the sample loops of every path kernel configuration checked for heap
+		//allocations, in the Debug builds which count them
+		if (argc > 1 && std::string(argv[1]) == "--check-allocations") {
+			Size checkSamples = 4096;
+			AutocallableSettings settings;
+			settings.pathKernel = true;
+			settings.antithetic = true;
+			settings.controlVariate = true;
+			bool passed = true;
+			const char models[] = { 'B', 'H', 'L' };
+			for (char model : models) {
+				std::string name = std::string("path kernel, model ") + model;
+				passed &= checkAllocations(name, [&]() {
+					autocall.compute(100, checkSamples, model, settings);
+				});
+			}
+			AutocallableSettings sobolSettings = settings;
+			sobolSettings.quasiRandom = true;
+			sobolSettings.scrambles = 4;
+			passed &= checkAllocations("path kernel, scrambled Sobol", [&]() {
+				autocall.compute(100, checkSamples, 'B', sobolSettings);
+			});
+			AutocallablePortfolio portfolio(underlying, qTermStructure, bondTermStructure, OISTermStructure,
+				volatility, settlementDate, std::vector<AutocallableTermSheet>(2, autocall.termSheet()), varTS);
+			passed &= checkAllocations("portfolio", [&]() {
+				portfolio.compute(0, checkSamples, 'B', settings);
+			});
+			QL_ENSURE(passed, "heap allocations in the sample loops");
+			return 0;
+		}
+
+		//adjoint sensitivities to the OIS and bond quotes, Black&Scholes
+		if (sensitivities) {
+			AutocallableSettings settings;
+			settings.observationGrid = true;
+			autocall.computeSensitivities(0, nSamples, OISQuotes, bondQuotes, settings);
+			return 0;
+		}
+
+		//a book of certificates on the same underlying, priced on one set of
+		//paths: the one above and variants struck from 90% to 110% of the spot;
+		//--check-control prices it under local volatility with and without
+		//the control variate, which must agree within their errors
+		bool checkControl = argc > 1 && std::string(argv[1]) == "--check-control";
+		if (checkControl || (argc > 1 && std::string(argv[1]) == "--portfolio")) {
+			AutocallableTermSheet certificate = autocall.termSheet();
+			std::vector<AutocallableTermSheet> book(1, certificate);
+			for (Size i = 0; i <= 20; i++) {
+				Real moneyness = 0.90 + 0.01 * i;
+				AutocallableTermSheet variant = certificate;
+				std::ostringstream name;
+				name << "strike " << std::fixed << std::setprecision(0) << moneyness * 100 << "%";
+				variant.name = name.str();
+				variant.startingLevel = moneyness * underlying->value();
+				variant.barrierLevel = certificate.barrierLevel * variant.startingLevel / certificate.startingLevel;
+				for (auto& r : variant.repayments)
+					r.exerciseLevel = variant.startingLevel;
+				book.push_back(variant);
+			}
+			AutocallablePortfolio portfolio(underlying, qTermStructure, bondTermStructure, OISTermStructure,
+				volatility, settlementDate, book, varTS);
+			AutocallableSettings settings;
+			settings.pathKernel = true;
+			settings.antithetic = true;
+			settings.controlVariate = true;
+			if (checkControl)
+				portfolio.checkControlVariate(100, nSamples, 'L', settings);
+			else
+				portfolio.compute(0, nSamples, 'B', settings);
+			return 0;
+		}
+
+		//the book of certificates of a term sheet file, e.g. termsheets.csv
+		if (argc > 2 && std::string(argv[1]) == "--book") {
+			std::vector<AutocallableTermSheet> book = loadTermSheets(argv[2], settlementDate);
+			AutocallablePortfolio portfolio(underlying, qTermStructure, bondTermStructure, OISTermStructure,
+				volatility, settlementDate, book, varTS);
+			AutocallableSettings settings;
+			settings.pathKernel = true;
+			settings.antithetic = true;
+			settings.controlVariate = true;
+			portfolio.compute(0, nSamples, 'B', settings);
+			return 0;
+		}
+
+		//repricing on ticks of the 2 years OIS quote: the OIS curve is only
+		//re-solved from the 2 years pillar on, and the dividend curve follows
+		if (ticks) {
+			AutocallableSettings settings;
+			settings.observationGrid = true;
+			auto OISCurve = boost::dynamic_pointer_cast<IncrementalDiscountCurve>(OISTermStructure);
+			//the quote of the 2 years swap, looked up by its tenor
+			std::vector<Period> OISTenors = MarketData::defaultquotes().OISTenors;
+			Size twoYearsPillar = std::find(OISTenors.begin(), OISTenors.end(), 2 * Years) - OISTenors.begin();
+			QL_REQUIRE(twoYearsPillar < OISQuotes.size(), "no 2 years OIS quote");
+			boost::shared_ptr<SimpleQuote> twoYears = OISQuotes[twoYearsPillar];
+			for (Size tick = 1; tick <= 5; tick++) {
+				twoYears->setValue(twoYears->value() + 0.0001);
+				std::cout << "\nTick " << tick << ": OIS 2Y = " << twoYears->value() << std::endl;
+				autocall.compute(0, nSamples, 'B', settings);
+				std::cout << "curva OIS risolta dal pilastro " << OISCurve->firstSolvedPillar() + 1
+					<< " di " << OISQuotes.size() << std::endl;
+			}
+			return 0;
+		}
+
 		//model choise
 		char modelType;
 		bool fails = false;
 		do {
 			std::cout << "Digita la scelta del modello con cui prezzare:\n\n";
 			std::cout << "   -) B per Black&Scholes;\n";
-			std::cout << "   -) H per Heston.\n\n";
+			std::cout << "   -) H per Heston;\n";
+			std::cout << "   -) L per volatilita' locale (Dupire).\n\n";
 			std::cin >> modelType;
 			modelType = toupper(modelType);
-			if ((modelType == 'B') || (modelType == 'H')){
-				autocall.compute(nTimeSteps, nSamples, modelType);
+			if ((modelType == 'B') || (modelType == 'H') || (modelType == 'L')){
+				AutocallableSettings settings;
+				settings.pathKernel = true;
+				//antithetic pairs and European control variate
+				settings.antithetic = true;
+				settings.controlVariate = true;
+				//scrambled Sobol draws: 16 scrambles of 1024 points each,
+				//a power of 2 keeping the Sobol points balanced
+				if (argc > 1 && std::string(argv[1]) == "--qmc") {
+					settings.quasiRandom = true;
+					settings.scrambles = 16;
+					nSamples = 16 * 1024;
+				}
+				Size steps = nTimeSteps;
+				//Black&Scholes is exact over any step: simulate the observation dates only
+				if (modelType == 'B') {
+					settings.observationGrid = true;
+					steps = 0;
+				}
+				//the quadratic-exponential Heston scheme needs about 50 steps a year
+				if (modelType == 'H')
+					steps = Size(std::ceil(50.0 * maturity));
+				//as many samples as needed for a standard error of 0.25
+				if (argc > 1 && std::string(argv[1]) == "--tolerance")
+					autocall.computeToTolerance(0.25, 200000, settings.batchSize, steps, modelType, settings);
+				else
+					autocall.compute(steps, nSamples, modelType, settings);
 				fails = false;
 			}
 			else {	
@@ -3,30 +3,55 @@
 
 using namespace QuantLib;
 
-Repayment occurredRepayment(const std::vector<Repayment>& earlyRepaiments,
-							const Path& stockPath,
-							const DayCounter& dayCount,
-							const Date& settlementDate);
-
-Real stockValue(const Path& path, const Date& date,
-				const DayCounter& dayCount, const Date& settlementDate);
-
-Real computeAverage(const Repayment& r, const Path& stockPath,
-					const DayCounter& dayCount,
-					const Date& settlementDate);
-
-
 // real constructor
 AutocallablePathPricer::AutocallablePathPricer(boost::shared_ptr<YieldTermStructure> bondTermStructure,
 	boost::shared_ptr<YieldTermStructure> OISTermStructure,
 	Time maturity,
 	Real strike,
 	Date settlementDate,
-	std::vector<Repayment> repayments)
+	std::vector<Repayment> repayments,
+	const TimeGrid& timeGrid)
 	: bondTermStructure_(bondTermStructure), OISTermStructure_(OISTermStructure), maturity_(maturity), strike_(strike), settlementDate_(settlementDate),
-	repayments_(repayments){
+	repayments_(repayments), gridSize_(timeGrid.size()) {
+	initialize(timeGrid, 9.0504, 58);
+}
+
+AutocallablePathPricer::AutocallablePathPricer(boost::shared_ptr<YieldTermStructure> bondTermStructure,
+	boost::shared_ptr<YieldTermStructure> OISTermStructure,
+	Date settlementDate,
+	const AutocallableTermSheet& termSheet,
+	const TimeGrid& timeGrid)
+	: bondTermStructure_(bondTermStructure), OISTermStructure_(OISTermStructure), strike_(termSheet.startingLevel), settlementDate_(settlementDate),
+	repayments_(termSheet.repayments), gridSize_(timeGrid.size()) {
+	QL_REQUIRE(!repayments_.empty(), "no repayments given");
+	maturity_ = ActualActual().yearFraction(settlementDate_, repayments_.back().paymentDate);
+	initialize(timeGrid, termSheet.barrierLevel, termSheet.plus);
+}
+
+void AutocallablePathPricer::initialize(const TimeGrid& timeGrid, Real barrierLevel, Real plus) {
 	QL_REQUIRE(maturity_ > 0.0, "maturity must be positive");
 	QL_REQUIRE(strike_ > 0.0, "strike must be positive");
+	QL_REQUIRE(!repayments_.empty(), "no repayments given");
+
+	// the grid and the dates are the same for all the paths: the grid point
+	// of each observation date is looked up once here. On a grid built from
+	// the observation times the closest point is the observation time itself.
+	DayCounter dayCount = ActualActual();
+	observationOffsets_.push_back(0);
+	for (auto const& r : repayments_) {
+		QL_REQUIRE(!r.evaluationDates.empty(), "repayment without observation dates");
+		for (auto const& obserDate : r.evaluationDates) {
+			auto dateTime = dayCount.yearFraction(settlementDate_, obserDate);
+			observationIndices_.push_back(timeGrid.closestIndex(dateTime));
+		}
+		observationOffsets_.push_back(observationIndices_.size());
+	}
+
+	startingLevel_ = strike_;
+	barrierLevel_ = barrierLevel;
+	Date plusDate = repayments_.front().paymentDate;
+	plusValue_ = plus * OISTermStructure_->discount(plusDate);
+	maturityCouponValue_ = repayments_.back().coupon * OISTermStructure_->discount(repayments_.back().paymentDate);
 }
 
 Real AutocallablePathPricer::operator()(const MultiPath& paths) const {
@@ -34,59 +59,124 @@ Real AutocallablePathPricer::operator()(const MultiPath& paths) const {
 	const Path& path = paths[0];
 	Size n = path.length() - 1;
 	QL_REQUIRE(n > 0, "the path cannot be empty");
+	QL_REQUIRE(path.length() == gridSize_, "the path is not on the pricer's time grid");
 
-	Calendar calendar = TARGET();
-	DayCounter dayCount = ActualActual();
+	return price(path.begin(), 1);
+}
 
-	Real startinglevel = strike_;
-	Real excerciselevel = 15.08;
-	Real barrierlevel = 9.0504;
-	Date barrierDate(01, March, 2021);
-	Real plus = 58;
-	Date plusDate = repayments_.front().paymentDate;
+Real AutocallablePathPricer::price(const Real* spots, Size stride) const {
 
 	//initialization of the price
-	Real price = plus * OISTermStructure_->discount(plusDate);
-
-	auto repayment = occurredRepayment(repayments_, path, dayCount, settlementDate_);
-	price += repayment.value;
-	if (repayment.paymentDate == repayments_.back().paymentDate) {
-		auto stock = stockValue(path, repayment.evaluationDates.back(), dayCount, settlementDate_);
-		if (stock < barrierlevel) {
-			price -= repayment.coupon * OISTermStructure_->discount(repayment.paymentDate);
-			auto faceNPV = repayment.value - repayment.coupon * OISTermStructure_->discount(repayment.paymentDate);
-			auto stock_performance = computeAverage(repayments_.back(), path, dayCount, settlementDate_);
-			price -= faceNPV * (1 - stock_performance / startinglevel);
+	Real price = plusValue_;
+
+	Real average;
+	Size repayment = occurredRepayment(spots, stride, average);
+	price += repayments_[repayment].value;
+	if (repayment == repayments_.size() - 1) {
+		auto stock = spots[observationIndices_.back() * stride];
+		if (stock < barrierLevel_) {
+			price -= maturityCouponValue_;
+			auto faceNPV = repayments_[repayment].value - maturityCouponValue_;
+			// the average is the maturity's one, the stock performance
+			price -= faceNPV * (1 - average / startingLevel_);
 		}
 	}
 	return price;
 }
 
-Repayment occurredRepayment(const std::vector<Repayment>& repayments,
-	const Path& stockPath,
-	const DayCounter& dayCount,
-	const Date& settlementDate) {
-	for (auto const& r : repayments) {
-		Real average = computeAverage(r, stockPath, dayCount, settlementDate);
-		if (average >= r.exerciseLevel){
-			return r;
-		}
+// smooth step from 0 to 1 around x = 0
+static inline Real logisticStep(Real x) {
+	return 1.0 / (1.0 + std::exp(-x));
+}
+
+/* The smoothed payoff is written backwards from maturity: C_i is the value
+of a certificate still alive before the i-th observation, with trigger
+probability H_i,
+	C_i = H_i*V_i + (1 - H_i)*C_{i+1},
+and at maturity C_n = V_n - (1 - B)*L, B being the smoothed indicator of the
+stock above the barrier and L the coupon and performance lost below it.
+The derivatives follow forwards, with A_i = (1 - H_0)...(1 - H_{i-1}) the
+smoothed probability of reaching the i-th observation:
+	dP/dH_i = A_i*(V_i - C_{i+1}).
+*/
+Real AutocallablePathPricer::smoothedPrice(const Real* spots, Size stride, Real smoothing,
+	Real* gradient) const {
+
+	QL_REQUIRE(smoothing > 0.0, "the smoothing width must be positive");
+	Size last = repayments_.size() - 1;
+
+	// maturity, the knock-in barrier being smoothed
+	Real average = computeAverage(last, spots, stride);
+	Real stock = spots[observationIndices_.back() * stride];
+	Real barrierWidth = smoothing * barrierLevel_;
+	Real above = logisticStep((stock - barrierLevel_) / barrierWidth);
+	Real faceNPV = repayments_[last].value - maturityCouponValue_;
+	Real loss = maturityCouponValue_ + faceNPV * (1 - average / startingLevel_);
+	Real continuation = repayments_[last].value - (1 - above) * loss;
+
+	// backwards through the autocall dates; C_{i+1} is kept in the first
+	// gradient slot of the i-th repayment until its derivatives are computed
+	for (Size i = last; i-- > 0;) {
+		gradient[observationOffsets_[i]] = continuation;
+		Real level = repayments_[i].exerciseLevel;
+		Real trigger = logisticStep((computeAverage(i, spots, stride) - level) / (smoothing * level));
+		continuation = trigger * repayments_[i].value + (1 - trigger) * continuation;
+	}
+	Real price = plusValue_ + continuation;
+
+	// forwards, the derivatives with respect to the averages and then
+	// to the spots averaged
+	Real alive = 1.0;
+	for (Size i = 0; i < last; i++) {
+		Size begin = observationOffsets_[i], end = observationOffsets_[i + 1];
+		Real next = gradient[begin];
+		Real level = repayments_[i].exerciseLevel;
+		Real width = smoothing * level;
+		Real trigger = logisticStep((computeAverage(i, spots, stride) - level) / width);
+		Real dAverage = alive * (repayments_[i].value - next) * trigger * (1 - trigger) / width;
+		for (Size j = begin; j < end; j++)
+			gradient[j] = dAverage / (end - begin);
+		alive *= 1 - trigger;
 	}
-	return repayments.back();
+	Size begin = observationOffsets_[last], end = observationOffsets_[last + 1];
+	Real dAverage = alive * (1 - above) * faceNPV / startingLevel_;
+	for (Size j = begin; j < end; j++)
+		gradient[j] = dAverage / (end - begin);
+	gradient[end - 1] += alive * loss * above * (1 - above) / barrierWidth;
+
+	return price;
 }
-	
-Real stockValue(const Path& path, const Date& date,
-				const DayCounter& dayCount, const Date& settlementDate) {
-	auto dateTime = dayCount.yearFraction(settlementDate, date);
-	return path.at(path.timeGrid().closestIndex(dateTime));
+
+Size AutocallablePathPricer::occurredRepayment(const Real* spots, Size stride, Real& average) const {
+	Size last = repayments_.size() - 1;
+	for (Size i = 0; i < last; i++) {
+		average = computeAverage(i, spots, stride);
+		if (average >= repayments_[i].exerciseLevel){
+			return i;
+		}
+	}
+	average = computeAverage(last, spots, stride);
+	return last;
 }
 
-Real computeAverage(const Repayment& r, const Path& stockPath, 
-	const DayCounter& dayCount,	const Date& settlementDate) {
+Real AutocallablePathPricer::computeAverage(Size repayment, const Real* spots, Size stride) const {
+	Size begin = observationOffsets_[repayment], end = observationOffsets_[repayment + 1];
 	Real average = 0;
-	for (auto const& obserDate : r.evaluationDates) {
-		average += stockValue(stockPath, obserDate, dayCount, settlementDate);
+	for (Size i = begin; i < end; i++) {
+		average += spots[observationIndices_[i] * stride];
 	}
-	average = average / r.evaluationDates.size();
+	average = average / (end - begin);
 	return average;
 }
+
+std::vector<Time> observationTimes(const std::vector<Repayment>& repayments,
+	const Date& settlementDate) {
+	DayCounter dayCount = ActualActual();
+	std::vector<Time> times;
+	for (auto const& r : repayments) {
+		for (auto const& obserDate : r.evaluationDates) {
+			times.push_back(dayCount.yearFraction(settlementDate, obserDate));
+		}
+	}
+	return times;
+}
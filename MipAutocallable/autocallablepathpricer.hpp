@@ -18,18 +18,110 @@ public:
 		Time maturity,
 		Real strike,
 		Date settlementDate, 
-		std::vector<Repayment> repayments);
+		std::vector<Repayment> repayments,
+		const TimeGrid& timeGrid);
+
+	// the pricer of any certificate, given its term sheet; the grid must
+	// hold its observation dates
+	AutocallablePathPricer(boost::shared_ptr<YieldTermStructure> bondTermStructure,
+		boost::shared_ptr<YieldTermStructure> OISTermStructure,
+		Date settlementDate,
+		const AutocallableTermSheet& termSheet,
+		const TimeGrid& timeGrid);
 
 	// The value() method encapsulates the pricing code
 	Real operator()(const MultiPath& paths) const;
-	
+
+	// prices a stock path given as the spots on the pricer's time grid,
+	// the i-th one being spots[i*stride]
+	Real price(const Real* spots, Size stride) const;
+
+	/* The same price with the autocall triggers and the knock-in barrier
+	smoothed by logistic steps, whose widths are `smoothing` times their
+	levels. The derivatives of the smoothed price with respect to the spots
+	at the observation dates are written to gradient, in the order of
+	observationIndices(). */
+	Real smoothedPrice(const Real* spots, Size stride, Real smoothing, Real* gradient) const;
+
+	/* The same smoothed price on any number type, the Numbers of the
+	adjoint mode in particular. The discounted values of the repayments, of
+	the plus and of the maturity coupon are taken as arguments instead of
+	the pricer's own, so that their derivatives are recorded as well. */
+	template <class T>
+	T smoothedPrice(const T* spots, Size stride, Real smoothing,
+		const T* repaymentValues, const T& plusValue, const T& maturityCouponValue) const;
+
+	// the discounted plus and maturity coupon the pricer uses
+	Real plusValue() const { return plusValue_; }
+	Real maturityCouponValue() const { return maturityCouponValue_; }
+
+	// grid points of the observation dates, all repayments in a row
+	const std::vector<Size>& observationIndices() const { return observationIndices_; }
+
 private:
+	// the grid points of the observation dates and the discounted amounts
+	void initialize(const TimeGrid& timeGrid, Real barrierLevel, Real plus);
+
+	// index of the repayment which occurs on the path and its average
+	Size occurredRepayment(const Real* spots, Size stride, Real& average) const;
+	Real computeAverage(Size repayment, const Real* spots, Size stride) const;
+
 	boost::shared_ptr<YieldTermStructure> bondTermStructure_;
 	boost::shared_ptr<YieldTermStructure> OISTermStructure_;
 	Time maturity_;
 	Real strike_;
 	Date settlementDate_;
 	std::vector<Repayment> repayments_;
+	Size gridSize_;
+
+	// Grid points of the observation dates, all repayments in a row: those
+	// of the i-th repayment lie in [observationOffsets_[i], observationOffsets_[i+1])
+	std::vector<Size> observationIndices_;
+	std::vector<Size> observationOffsets_;
+
+	// product data and discount factors, which are the same for every path
+	Real startingLevel_;
+	Real barrierLevel_;
+	Real plusValue_;
+	Real maturityCouponValue_;
 };
 
+// C_i = H_i*V_i + (1 - H_i)*C_{i+1} backwards from maturity, as in the
+// Real version, without the derivatives
+template <class T>
+T AutocallablePathPricer::smoothedPrice(const T* spots, Size stride, Real smoothing,
+	const T* repaymentValues, const T& plusValue, const T& maturityCouponValue) const {
+
+	using std::exp;
+	QL_REQUIRE(smoothing > 0.0, "the smoothing width must be positive");
+	Size last = repayments_.size() - 1;
+
+	auto average = [&](Size repayment) {
+		Size begin = observationOffsets_[repayment], end = observationOffsets_[repayment + 1];
+		T sum = spots[observationIndices_[begin] * stride];
+		for (Size i = begin + 1; i < end; i++)
+			sum += spots[observationIndices_[i] * stride];
+		return sum / Real(end - begin);
+	};
+
+	// maturity, the knock-in barrier being smoothed
+	T stock = spots[observationIndices_.back() * stride];
+	T above = 1.0 / (1.0 + exp(-(stock - barrierLevel_) / (smoothing * barrierLevel_)));
+	T faceNPV = repaymentValues[last] - maturityCouponValue;
+	T loss = maturityCouponValue + faceNPV * (1.0 - average(last) / startingLevel_);
+	T continuation = repaymentValues[last] - (1.0 - above) * loss;
+
+	for (Size i = last; i-- > 0;) {
+		Real level = repayments_[i].exerciseLevel;
+		T trigger = 1.0 / (1.0 + exp(-(average(i) - level) / (smoothing * level)));
+		continuation = trigger * repaymentValues[i] + (1.0 - trigger) * continuation;
+	}
+	return plusValue + continuation;
+}
+
+// times of all the observation dates, in the pricer's day count convention:
+// the mandatory points of a grid simulating the observation dates only
+std::vector<Time> observationTimes(const std::vector<Repayment>& repayments,
+	const Date& settlementDate);
+
 #endif 
@@ -0,0 +1,210 @@
+#include <ql/quantlib.hpp>
+#include <autocallableportfolio.hpp>
+#include <autocallablepathpricer.hpp>
+#include <parallelmontecarlo.hpp>
+#include <pathkernel.hpp>
+#include <allocationcounter.hpp>
+#include <variancereduction.hpp>
+#include <chrono>
+
+using namespace QuantLib;
+
+AutocallablePortfolio::AutocallablePortfolio(boost::shared_ptr<Quote> underlying,
+	boost::shared_ptr<YieldTermStructure> qTermStructure,
+	boost::shared_ptr<YieldTermStructure> bondTermStructure,
+	boost::shared_ptr<YieldTermStructure> OISTermStructure,
+	boost::shared_ptr<BlackVolTermStructure> volatility,
+	Date settlementDate,
+	const std::vector<AutocallableTermSheet>& termSheets,
+	boost::shared_ptr<BlackVolTermStructure> impliedVolatility)
+	: underlying_(underlying), qTermStructure_(qTermStructure), bondTermStructure_(bondTermStructure),
+	OISTermStructure_(OISTermStructure), volatility_(volatility), impliedVolatility_(impliedVolatility),
+	settlementDate_(settlementDate), termSheets_(termSheets) {
+	QL_REQUIRE(!termSheets_.empty(), "no certificates in the portfolio");
+}
+
+std::vector<Real> AutocallablePortfolio::compute(Size nTimeSteps, Size nSamples, char modelType,
+	const AutocallableSettings& settings, std::vector<Real>* errors) const {
+
+	QL_REQUIRE(nSamples > 0, "the number of samples must be > 0");
+	QL_REQUIRE(settings.batchSize > 0, "the batch size must be > 0");
+	QL_REQUIRE(!settings.quasiRandom, "the portfolio is priced on pseudo-random draws");
+	QL_REQUIRE(settings.pathKernel, "the portfolio is evolved by the path kernel");
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Size nProducts = termSheets_.size();
+
+	// the repayments are valued on today's curves, and the grid holds the
+	// observation dates of every certificate
+	std::vector<AutocallableTermSheet> termSheets = termSheets_;
+	std::vector<Time> mandatoryTimes;
+	for (auto& termSheet : termSheets) {
+		for (auto& r : termSheet.repayments)
+			r.value = repaymentValue(r, OISTermStructure_, bondTermStructure_);
+		std::vector<Time> times = observationTimes(termSheet.repayments, settlementDate_);
+		mandatoryTimes.insert(mandatoryTimes.end(), times.begin(), times.end());
+	}
+	TimeGrid grid = nTimeSteps > 0
+		? TimeGrid(mandatoryTimes.begin(), mandatoryTimes.end(), nTimeSteps)
+		: TimeGrid(mandatoryTimes.begin(), mandatoryTimes.end());
+
+	Size nBatches = (nSamples + settings.batchSize - 1) / settings.batchSize;
+	Size nThreads = settings.nThreads > 0 ? settings.nThreads : defaultThreads();
+	nThreads = std::min(nThreads, nBatches);
+	Size maxBatch = std::min(settings.batchSize, nSamples);
+	auto batchLength = [&](Size batch) {
+		return std::min(settings.batchSize, nSamples - batch * settings.batchSize);
+	};
+
+	boost::shared_ptr<LocalVolTermStructure> localVolatilityTable;
+	if (modelType == 'L')
+		localVolatilityTable = tabulatedLocalVolatility(underlying_, qTermStructure_,
+			OISTermStructure_, impliedVolatility_, grid.back());
+
+	// The pricers only read data computed here, and are shared by the
+	// workers; the processes, kernels and buffers are built per worker
+	// before the threads start.
+	std::vector<boost::shared_ptr<AutocallablePathPricer>> pathPricers;
+	for (auto const& termSheet : termSheets)
+		pathPricers.push_back(boost::shared_ptr<AutocallablePathPricer>(
+			new AutocallablePathPricer(bondTermStructure_, OISTermStructure_, settlementDate_,
+				termSheet, grid)));
+
+	std::vector<boost::shared_ptr<StochasticProcess>> diffusions;
+	std::vector<boost::shared_ptr<PathKernel>> pathKernels;
+	std::vector<PathArena> arenas;
+	for (Size i = 0; i < nThreads; i++) {
+		auto Mydiffusion = choseDiffusion(modelType, underlying_, qTermStructure_, OISTermStructure_,
+			volatility_, localVolatilityTable);
+		Mydiffusion->diffusion(0.0, Mydiffusion->initialValues());
+		diffusions.push_back(Mydiffusion);
+		pathKernels.push_back(boost::shared_ptr<PathKernel>(new PathKernel(Mydiffusion, grid,
+			settings.hestonScheme)));
+		arenas.push_back(PathArena(pathKernels.back()->dimension(), grid.size(), maxBatch));
+	}
+
+	// a single control for the prices of all the certificates, with a mean
+	// known exactly under the simulated paths: under Black&Scholes the
+	// discounted put on the spot at the end of the grid, struck at their mean
+	// starting level and valued by Black's formula. The other models fall
+	// back to the discounted spot, whose mean is the dividend-discounted
+	// initial spot.
+	Time controlTime = grid.back();
+	DiscountFactor controlDiscount = OISTermStructure_->discount(controlTime);
+	Real controlStrike = 0.0;
+	for (auto const& termSheet : termSheets)
+		controlStrike += termSheet.startingLevel / nProducts;
+	Real controlValue = europeanPutValue(modelType, diffusions.front(), controlStrike, controlTime);
+	bool putControl = (controlValue != Null<Real>());
+	if (!putControl)
+		controlValue = underlying_->value() * qTermStructure_->discount(controlTime);
+
+	// the prices and controls of the first leg of the antithetic pairs,
+	// product-major: legPrices[i*maxBatch + p]
+	std::vector<std::vector<Real> > legPrices(nThreads, std::vector<Real>(nProducts * maxBatch));
+	std::vector<std::vector<Real> > legControls(nThreads, std::vector<Real>(maxBatch));
+
+	// the sums of batch b and product i are batchSums[b*nProducts + i]
+	std::vector<VarianceReductionSums> batchSums(nBatches * nProducts);
+
+	auto priceBatch = [&](Size batch, Size worker) {
+
+		Size batchSamples = batchLength(batch);
+		PathArena& arena = arenas[worker];
+		const PathKernel& kernel = *pathKernels[worker];
+		std::vector<Real>& prices = legPrices[worker];
+		std::vector<Real>& controls = legControls[worker];
+		VarianceReductionSums* sums = &batchSums[batch * nProducts];
+		const Real* finalSpots = &arena.spots[(grid.size() - 1) * batchSamples];
+		Size legs = settings.antithetic ? 2 : 1;
+
+		PseudoRandom::rsg_type rsg = PseudoRandom::make_sequence_generator(kernel.dimension(),
+			streamSeed(settings.seed, batch));
+
+		Size allocations = allocationCount();
+		arena.draw(rsg, batchSamples);
+		for (Size leg = 0; leg < legs; leg++) {
+			if (leg > 0) {
+				Size nDraws = kernel.dimension() * batchSamples;
+				for (Size d = 0; d < nDraws; d++)
+					arena.normals[d] = -arena.normals[d];
+			}
+			kernel.evolve(&arena.normals[0], batchSamples, &arena.spots[0], &arena.workspace[0]);
+
+			// every certificate on each path
+			for (Size p = 0; p < batchSamples; p++) {
+				Real control = controlDiscount * (putControl
+					? std::max<Real>(controlStrike - finalSpots[p], 0.0) : finalSpots[p]);
+				if (leg + 1 < legs)
+					controls[p] = control;
+				else if (legs > 1)
+					control = 0.5 * (control + controls[p]);
+				for (Size i = 0; i < nProducts; i++) {
+					Real price = pathPricers[i]->price(&arena.spots[p], batchSamples);
+					sums[i].addPath(price);
+					if (leg + 1 < legs) {
+						prices[i * maxBatch + p] = price;
+						continue;
+					}
+					if (legs > 1)
+						price = 0.5 * (price + prices[i * maxBatch + p]);
+					sums[i].addSample(price, control);
+				}
+			}
+		}
+		countLoopAllocations(allocationCount() - allocations);
+	};
+
+	runBatches(nBatches, nThreads, priceBatch);
+
+	// the batches are merged in batch order, product by product
+	std::vector<Real> prices(nProducts);
+	if (errors)
+		errors->resize(nProducts);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "\nPortafoglio di " << nProducts << " certificati su " << nSamples
+		<< " scenari (" << grid.size() - 1 << " passi, " << std::fixed << std::setprecision(2)
+		<< elapsed.count() << " s)\n" << std::endl;
+	std::cout << std::setw(24) << "certificato" << " | " << std::setw(12) << "prezzo"
+		<< " | " << std::setw(10) << "errore" << "\n" << std::string(52, '-') << std::endl;
+	for (Size i = 0; i < nProducts; i++) {
+		VarianceReductionSums sums;
+		for (Size b = 0; b < nBatches; b++)
+			sums.merge(batchSums[b * nProducts + i]);
+		Real beta = settings.controlVariate ? sums.beta() : 0.0;
+		prices[i] = sums.mean(beta, controlValue);
+		Real error = sums.samples > 1 ? sums.errorEstimate(beta) : 0.0;
+		if (errors)
+			(*errors)[i] = error;
+		std::cout << std::setw(24) << termSheets[i].name << " | " << std::setw(12) << std::setprecision(4)
+			<< prices[i] << " | " << std::setw(10) << error << std::endl;
+	}
+	return prices;
+}
+
+// The controlled and uncontrolled prices share their draws, so that their
+// difference is far smaller than the sum of their errors unless the mean
+// of the control is wrong: the joint error is a bound on its spread.
+void AutocallablePortfolio::checkControlVariate(Size nTimeSteps, Size nSamples, char modelType,
+	const AutocallableSettings& settings, Real tolerance) const {
+
+	AutocallableSettings plainSettings = settings;
+	plainSettings.controlVariate = false;
+	AutocallableSettings controlSettings = settings;
+	controlSettings.controlVariate = true;
+	std::vector<Real> plainErrors, controlErrors;
+	std::vector<Real> plainPrices = compute(nTimeSteps, nSamples, modelType, plainSettings, &plainErrors);
+	std::vector<Real> controlPrices = compute(nTimeSteps, nSamples, modelType, controlSettings, &controlErrors);
+
+	Real maxDeviation = 0.0;
+	for (Size i = 0; i < size(); i++) {
+		Real jointError = std::sqrt(plainErrors[i] * plainErrors[i] + controlErrors[i] * controlErrors[i]);
+		Real deviation = std::fabs(controlPrices[i] - plainPrices[i]) / jointError;
+		maxDeviation = std::max(maxDeviation, deviation);
+	}
+	std::cout << "\nVerifica della variabile di controllo: massimo scarto tra i prezzi = "
+		<< std::fixed << std::setprecision(2) << maxDeviation
+		<< " errori standard congiunti (tolleranza " << tolerance << ")" << std::endl;
+	QL_ENSURE(maxDeviation < tolerance, "the controlled prices differ from the plain ones by "
+		<< maxDeviation << " joint standard errors");
+}
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef autocallable_portfolio_hpp
+#define autocallable_portfolio_hpp
+
+#include <ql/quantlib.hpp>
+#include <autocallablesimulation.hpp>
+
+using namespace QuantLib;
+
+/* The AutocallablePortfolio class prices a book of certificates on the same
+underlying over a single set of Monte Carlo scenarios.
+
+Each path is simulated once, on a grid holding the observation dates of
+all the certificates, and is priced by the path pricer of every
+certificate in turn, so that the cost of the paths is shared by the whole
+book. The paths are evolved in batches by the vectorised path kernel, from
+the pseudo-random stream of their batch as in AutocallableSimulation: for
+a given seed and batch size the prices do not depend on the number of
+threads.
+*/
+
+class AutocallablePortfolio {
+public:
+	AutocallablePortfolio(boost::shared_ptr<Quote> underlying,
+		boost::shared_ptr<YieldTermStructure> qTermStructure,
+		boost::shared_ptr<YieldTermStructure> bondTermStructure,
+		boost::shared_ptr<YieldTermStructure> OISTermStructure,
+		boost::shared_ptr<BlackVolTermStructure> volatility,
+		Date settlementDate,
+		const std::vector<AutocallableTermSheet>& termSheets,
+		boost::shared_ptr<BlackVolTermStructure> impliedVolatility = boost::shared_ptr<BlackVolTermStructure>());
+
+	/* Prices of the certificates, in the order of their term sheets, with
+	their standard errors written to errors if given. nTimeSteps bounds the
+	step size of the grid, as for an observation grid of
+	AutocallableSimulation, and the antithetic paths, the control variate
+	(under Black&Scholes a put on the spot at the end of the grid, struck at
+	the mean starting level, under the other models the discounted spot, as
+	in AutocallableSimulation), the batches and the Heston scheme are taken
+	from the settings.
+	The draws are pseudo-random and the paths are evolved by the path
+	kernel, which settings.pathKernel must select. */
+	std::vector<Real> compute(Size nTimeSteps, Size nSamples, char modelType,
+		const AutocallableSettings& settings = AutocallableSettings(),
+		std::vector<Real>* errors = 0) const;
+
+	// check of the control variate: the book is priced with and without
+	// it, on the same draws, and the check fails if the two prices of a
+	// certificate differ by tolerance times their joint standard error
+	void checkControlVariate(Size nTimeSteps, Size nSamples, char modelType,
+		const AutocallableSettings& settings = AutocallableSettings(), Real tolerance = 3.0) const;
+
+	Size size() const { return termSheets_.size(); }
+
+private:
+	boost::shared_ptr<Quote> underlying_;
+	boost::shared_ptr<YieldTermStructure> qTermStructure_;
+	boost::shared_ptr<YieldTermStructure> bondTermStructure_;
+	boost::shared_ptr<YieldTermStructure> OISTermStructure_;
+	boost::shared_ptr<BlackVolTermStructure> volatility_;
+	boost::shared_ptr<BlackVolTermStructure> impliedVolatility_;
+	Date settlementDate_;
+	std::vector<AutocallableTermSheet> termSheets_;
+};
+
+#endif
@@ -1,18 +1,22 @@
 #include <ql/quantlib.hpp>
 #include <autocallablesimulation.hpp>
 #include <autocallablepathpricer.hpp>
+#include <referencepathpricer.hpp>
+#include <parallelmontecarlo.hpp>
+#include <pathkernel.hpp>
+#include <allocationcounter.hpp>
+#include <sobolbridge.hpp>
+#include <variancereduction.hpp>
+#include <aad.hpp>
+#include <sensitivities.hpp>
+#include <cachedlocalvolsurface.hpp>
+#include <algorithm>
+#include <chrono>
 
 using namespace QuantLib;
 
-Real repaymentValue(const Repayment& repayment,
-	boost::shared_ptr<YieldTermStructure> riskFreeTermStructure,
-	boost::shared_ptr<YieldTermStructure> riskyTermStructure);
-
-boost::shared_ptr<StochasticProcess> choseDiffusion(char modelType,
-	boost::shared_ptr<Quote>(underlying),
-	boost::shared_ptr<YieldTermStructure>(qTermStructure),
-	boost::shared_ptr<YieldTermStructure>(OISTermStructure),
-	boost::shared_ptr<BlackVolTermStructure>(volatility));
+Real nanosecondsPerPath(const PathPricer<MultiPath>& pricer,
+	const std::vector<MultiPath>& paths, Real& meanPrice);
 
 AutocallableSimulation::AutocallableSimulation(boost::shared_ptr<Quote> underlying,	
 	boost::shared_ptr<YieldTermStructure> qTermStructure,
@@ -21,13 +25,731 @@ AutocallableSimulation::AutocallableSimulation(boost::shared_ptr<Quote> underlyi
 	boost::shared_ptr<BlackVolTermStructure> volatility,
 	Time maturity,
 	Real strike,
-	Date settlementDate)
+	Date settlementDate,
+	boost::shared_ptr<BlackVolTermStructure> impliedVolatility)
 	: underlying_(underlying), qTermStructure_(qTermStructure),	bondTermStructure_(bondTermStructure),
-	OISTermStructure_(OISTermStructure), volatility_(volatility), maturity_(maturity), strike_(strike), settlementDate_(settlementDate){
+	OISTermStructure_(OISTermStructure), volatility_(volatility), impliedVolatility_(impliedVolatility),
+	maturity_(maturity), strike_(strike), settlementDate_(settlementDate){
+}
+
+
+void AutocallableSimulation::compute(Size nTimeSteps, Size nSamples, char modelType,
+	const AutocallableSettings& settings) {
+	simulate(nTimeSteps, nSamples, modelType, settings, 0.0);
+}
+
+void AutocallableSimulation::computeToTolerance(Real absErr, Size maxSamples, Size batchSize,
+	Size nTimeSteps, char modelType, const AutocallableSettings& settings) {
+	QL_REQUIRE(absErr > 0.0, "the error tolerance must be positive");
+	QL_REQUIRE(!settings.quasiRandom,
+		"the standard error of the tolerance mode needs pseudo-random draws");
+	AutocallableSettings batchSettings = settings;
+	batchSettings.batchSize = batchSize;
+	simulate(nTimeSteps, maxSamples, modelType, batchSettings, absErr);
+}
+
+void AutocallableSimulation::simulate(Size nTimeSteps, Size nSamples, char modelType,
+	const AutocallableSettings& settings, Real absErr) {
+
+	QL_REQUIRE(nSamples > 0, "the number of samples must be > 0");
+	QL_REQUIRE(settings.batchSize > 0, "the batch size must be > 0");
+	QL_REQUIRE(nTimeSteps > 0 || settings.observationGrid,
+		"the number of steps must be > 0 on a uniform grid");
+
+	// EarlyRepaiments, valued on the bond and OIS curves
+	std::vector<Repayment> repayments = buildRepayments();
+
+	QL_REQUIRE(!settings.quasiRandom || settings.pathKernel,
+		"the quasi-random draws need the vectorised path kernel");
+
+	// The samples are split into batches of settings.batchSize paths.
+	// Batch b draws from the stream streamSeed(seed, b) and its prices are
+	// stored in its own slot, so the price only depends on the seed and the
+	// batch size, not on how many workers priced the batches.
+	// With quasi-random draws each scramble is a full run over the first
+	// nSamples/scrambles Sobol points, split into batches in the same way:
+	// a batch takes its points from their position in the sequence.
+	Size replicates = settings.quasiRandom ? std::max<Size>(settings.scrambles, 1) : 1;
+	QL_REQUIRE(nSamples % replicates == 0,
+		"the number of samples must be a multiple of the scrambles");
+	Size replicateSamples = nSamples / replicates;
+	Size replicateBatches = (replicateSamples + settings.batchSize - 1) / settings.batchSize;
+	Size nBatches = replicates * replicateBatches;
+	Size nThreads = settings.nThreads > 0 ? settings.nThreads : defaultThreads();
+	nThreads = std::min(nThreads, nBatches);
+
+	switch (modelType)
+	{
+	case ('B'):
+		std::cout << "\nCalcolo del prezzo con il modello di Black&Scholes...\n" << std::endl;
+		break;
+	case('H'):
+		std::cout << "\nCalcolo del prezzo con il modello di Heston...\n" << std::endl;
+		break;
+	case('L'):
+		std::cout << "\nCalcolo del prezzo con il modello a volatilita' locale...\n" << std::endl;
+		break;
+	}
+
+	TimeGrid grid = simulationGrid(nTimeSteps, repayments, settings);
+
+	// the local volatility table is shared by the workers' processes:
+	// it is only read once it is built
+	boost::shared_ptr<LocalVolTermStructure> localVolatilityTable;
+	if (modelType == 'L')
+		localVolatilityTable = tabulatedLocalVolatility(underlying_, qTermStructure_,
+			OISTermStructure_, impliedVolatility_, grid.back());
+
+	// Every worker gets its own diffusion process and path pricer. They are
+	// built here, before the threads start, since they register themselves
+	// with the shared term structures.
+	std::vector<boost::shared_ptr<StochasticProcess>> diffusions;
+	std::vector<boost::shared_ptr<AutocallablePathPricer>> pathPricers;
+	std::vector<boost::shared_ptr<PathKernel>> pathKernels;
+	std::vector<PathArena> arenas;
+
+	for (Size i = 0; i < nThreads; i++) {
+		auto Mydiffusion = choseDiffusion(modelType,underlying_,qTermStructure_,OISTermStructure_,volatility_,
+			localVolatilityTable);
+		// the Black&Scholes local volatility is set up lazily at the first
+		// evolve() call: force it here rather than inside the worker
+		Mydiffusion->diffusion(0.0, Mydiffusion->initialValues());
+		diffusions.push_back(Mydiffusion);
+
+		pathPricers.push_back(boost::shared_ptr<AutocallablePathPricer>(
+			new AutocallablePathPricer(bondTermStructure_,
+				OISTermStructure_,
+				maturity_,
+				strike_,
+				settlementDate_,
+				repayments,
+				grid)));
+
+		// the kernel evolves the worker's batches in its own arena
+		if (settings.pathKernel) {
+			pathKernels.push_back(boost::shared_ptr<PathKernel>(new PathKernel(Mydiffusion, grid,
+				settings.hestonScheme)));
+			arenas.push_back(PathArena(pathKernels.back()->dimension(), grid.size(),
+				std::min(settings.batchSize, replicateSamples)));
+		}
+	}
+
+	// The control variate is a function of the spot at the end of the grid
+	// whose mean under the simulated paths is known exactly: under
+	// Black&Scholes the discounted put struck at the starting level, valued
+	// by Black's formula. The other models fall back to the discounted spot,
+	// whose mean is the dividend-discounted initial spot; a closed form of
+	// the continuous model would bias the controlled price by beta times
+	// the discretization error of the put.
+	Time controlTime = grid.back();
+	DiscountFactor controlDiscount = OISTermStructure_->discount(controlTime);
+	Real controlValue = europeanPutValue(modelType, diffusions.front(), strike_, controlTime);
+	bool putControl = (controlValue != Null<Real>());
+	if (!putControl)
+		controlValue = underlying_->value() * qTermStructure_->discount(controlTime);
+	auto controlPayoff = [&](Real spot) {
+		return controlDiscount * (putControl ? std::max<Real>(strike_ - spot, 0.0) : spot);
+	};
+
+	// the prices and controls of the first leg of the antithetic pairs
+	Size maxBatch = std::min(settings.batchSize, replicateSamples);
+	std::vector<std::vector<Real> > legPrices(nThreads, std::vector<Real>(maxBatch));
+	std::vector<std::vector<Real> > legControls(nThreads, std::vector<Real>(maxBatch));
+
+	// the first sample of a batch within its scramble, and the batch size
+	auto batchStart = [&](Size batch) {
+		return (batch % replicateBatches) * settings.batchSize;
+	};
+	auto batchLength = [&](Size batch) {
+		return std::min(settings.batchSize, replicateSamples - batchStart(batch));
+	};
+
+	// the accumulators get room for their batch beforehand, so that
+	// filling them does not reallocate inside the sample loop
+	std::vector<Statistics> batchAccumulators(nBatches);
+	std::vector<VarianceReductionSums> batchSums(nBatches);
+	for (Size b = 0; b < nBatches; b++)
+		batchAccumulators[b].reserve(batchLength(b));
+
+	// The Monte Carlo model generates paths, according to the "diffusion process", 
+	//using the PathGenerator
+	// each path is priced using thePathPricer
+	// prices will be accumulated into the batch's statisticsAccumulator
+	auto priceBatch = [&](Size batch, Size worker) {
+
+		const boost::shared_ptr<StochasticProcess>& Mydiffusion = diffusions[worker];
+		Size batchSamples = batchLength(batch);
+		Statistics& statisticsAccumulator = batchAccumulators[batch];
+		VarianceReductionSums& sums = batchSums[batch];
+
+		// the batch is evolved as a block from the given draws, and once
+		// more from the opposite draws for the antithetic paths; the spots
+		// of path p are then spots[i*batchSamples + p]
+		auto evolveBatch = [&](auto& draws) {
+			PathArena& arena = arenas[worker];
+			std::vector<Real>& prices = legPrices[worker];
+			std::vector<Real>& controls = legControls[worker];
+			const Real* finalSpots = &arena.spots[(grid.size() - 1) * batchSamples];
+			Size legs = settings.antithetic ? 2 : 1;
+
+			Size allocations = allocationCount();
+			arena.draw(draws, batchSamples);
+			for (Size leg = 0; leg < legs; leg++) {
+				if (leg > 0) {
+					Size nDraws = pathKernels[worker]->dimension() * batchSamples;
+					for (Size d = 0; d < nDraws; d++)
+						arena.normals[d] = -arena.normals[d];
+				}
+				pathKernels[worker]->evolve(&arena.normals[0], batchSamples,
+					&arena.spots[0], &arena.workspace[0]);
+				for (Size p = 0; p < batchSamples; p++) {
+					Real price = pathPricers[worker]->price(&arena.spots[p], batchSamples);
+					Real control = controlPayoff(finalSpots[p]);
+					sums.addPath(price);
+					if (leg + 1 < legs) {
+						prices[p] = price;
+						controls[p] = control;
+						continue;
+					}
+					if (legs > 1) {
+						price = 0.5 * (price + prices[p]);
+						control = 0.5 * (control + controls[p]);
+					}
+					statisticsAccumulator.add(price);
+					sums.addSample(price, control);
+				}
+			}
+			countLoopAllocations(allocationCount() - allocations);
+		};
+
+		if (settings.quasiRandom) {
+			Size replicate = batch / replicateBatches;
+			SobolBridgeRsg draws(Mydiffusion->factors(), grid,
+				settings.scrambles > 0 ? streamSeed(settings.seed, replicate) : 0,
+				settings.brownianBridge);
+			draws.skipTo(batchStart(batch));
+			evolveBatch(draws);
+			return;
+		}
+
+		PseudoRandom::rsg_type rsg = PseudoRandom::make_sequence_generator(Mydiffusion->factors() * (grid.size() - 1),
+			streamSeed(settings.seed, batch));
+
+		if (settings.pathKernel) {
+			evolveBatch(rsg);
+			return;
+		}
+
+		// The path generator evolves the paths through the diffusion process.
+		// Each path is priced where the generator stores it, rather than
+		// copied into a Sample as MonteCarloModel does; QuantLib's
+		// multi-dimensional evolve() still returns a new Array at each step.
+		typedef MultiVariate<PseudoRandom>::path_generator_type generator_type;
+		generator_type MyPathGenerator(Mydiffusion, grid, rsg, false);
+		const AutocallablePathPricer& pathPricer = *pathPricers[worker];
+
+		for (Size p = 0; p < batchSamples; p++) {
+			const MultiPath& path = MyPathGenerator.next().value;
+			Real price = pathPricer(path);
+			Real control = controlPayoff(path[0].back());
+			sums.addPath(price);
+			if (settings.antithetic) {
+				// the antithetic path overwrites the one above in the generator
+				const MultiPath& antitheticPath = MyPathGenerator.antithetic().value;
+				Real antitheticPrice = pathPricer(antitheticPath);
+				sums.addPath(antitheticPrice);
+				price = 0.5 * (price + antitheticPrice);
+				control = 0.5 * (control + controlPayoff(antitheticPath[0].back()));
+			}
+			statisticsAccumulator.add(price);
+			sums.addSample(price, control);
+		}
+	};
+
+	// With a tolerance, the batches are priced in waves of a few batches per
+	// worker. After each wave the running error is checked batch after batch,
+	// in batch order, and the run stops at the first batch bringing it below
+	// the tolerance: the batches priced past it are dropped, so that where
+	// the run stops does not depend on the number of threads either.
+	Size usedBatches = nBatches;
+	if (absErr <= 0.0) {
+		runBatches(nBatches, nThreads, priceBatch);
+	}
+	else {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		VarianceReductionSums running;
+		Size waveBatches = 4 * nThreads;
+		bool converged = false;
+		for (Size first = 0; first < nBatches && !converged; first += waveBatches) {
+			Size wave = std::min(waveBatches, nBatches - first);
+			runBatches(wave, nThreads, [&](Size batch, Size worker) {
+				priceBatch(first + batch, worker);
+			});
+			for (Size b = first; b < first + wave && !converged; b++) {
+				running.merge(batchSums[b]);
+				usedBatches = b + 1;
+				// a single batch does not give a reliable error estimate
+				if (b > 0) {
+					Real runningBeta = settings.controlVariate ? running.beta() : 0.0;
+					converged = running.errorEstimate(runningBeta) < absErr;
+				}
+			}
+			Real runningBeta = settings.controlVariate ? running.beta() : 0.0;
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			printConvergence(running.samples, running.mean(runningBeta, controlValue),
+				running.errorEstimate(runningBeta), elapsed.count());
+		}
+	}
+
+	// the batches are merged in batch order
+	Statistics statisticsAccumulator;
+	VarianceReductionSums sums;
+	for (Size b = 0; b < usedBatches; b++) {
+		mergeStatistics(statisticsAccumulator, batchAccumulators[b]);
+		sums.merge(batchSums[b]);
+	}
+
+	// the control coefficient is regressed once over all the samples
+	Real beta = settings.controlVariate ? sums.beta() : 0.0;
+	Real Price = settings.controlVariate ? sums.mean(beta, controlValue) : statisticsAccumulator.mean();
+
+	std::cout << " \nQuotazione = " << 1005.32 << std::endl;
+	std::cout << " \nPrice = " << Price << std::endl;
+	std::cout << " \nErrore = " << abs(1-Price/ 1005.32) * 100 << " % " << std::endl;
+
+	if (absErr > 0.0 || settings.antithetic || settings.controlVariate)
+		std::cout << " \nErrore standard = " << sums.errorEstimate(beta)
+			<< " (" << sums.samples << " campioni)" << std::endl;
+	if (settings.antithetic || settings.controlVariate)
+		std::cout << " \nFattore di riduzione della varianza = " << sums.reductionFactor(beta) << std::endl;
+
+	// the randomised-QMC error, from the spread of the prices of the
+	// independent scrambles
+	if (settings.quasiRandom && settings.scrambles > 1) {
+		Statistics replicatePrices;
+		for (Size r = 0; r < replicates; r++) {
+			VarianceReductionSums replicateSums;
+			for (Size b = r * replicateBatches; b < (r + 1) * replicateBatches; b++)
+				replicateSums.merge(batchSums[b]);
+			replicatePrices.add(replicateSums.mean(beta, controlValue));
+		}
+		std::cout << " \nErrore standard RQMC (" << settings.scrambles << " scrambles) = "
+			<< replicatePrices.errorEstimate() << std::endl;
+	}
+}
+
+// The paths are simulated either on nTimeSteps uniform steps up to
+// maturity or on the observation dates, the only points the pricer
+// looks at, plus the inner steps needed to keep dt below T/nTimeSteps.
+TimeGrid AutocallableSimulation::simulationGrid(Size nTimeSteps,
+	const std::vector<Repayment>& repayments, const AutocallableSettings& settings) const {
+	if (!settings.observationGrid)
+		return TimeGrid(maturity_, nTimeSteps);
+	std::vector<Time> mandatoryTimes = observationTimes(repayments, settlementDate_);
+	if (nTimeSteps > 0)
+		return TimeGrid(mandatoryTimes.begin(), mandatoryTimes.end(), nTimeSteps);
+	return TimeGrid(mandatoryTimes.begin(), mandatoryTimes.end());
 }
 
+// The Greeks are computed on the same Black&Scholes paths as the price.
+// The price of a path depends on the spots at the observation dates only:
+// its derivatives with respect to them come from the smoothed payoff of the
+// pricer, and each spot S(t) = s0*exp(R(t) - sigma^2*t/2 + sigma*W(t)) has
+//   dS/ds0 = S/s0,   dS/dsigma = S*(W(t) - sigma*t),
+// which give the pathwise delta and vega. The gamma is the likelihood ratio
+// derivative of the pathwise delta: moving s0 is the same as a drift of W
+// up to the first observation time tau, so that its score is
+// W(tau)/(s0*sigma*tau), and then
+//   gamma = E[delta_path*(W(tau)/(s0*sigma*tau) - 1/s0)].
+void AutocallableSimulation::computeGreeks(Size nTimeSteps, Size nSamples,
+	const AutocallableSettings& settings, Real smoothing) {
+
+	QL_REQUIRE(nSamples > 1, "the number of samples must be > 1");
+	QL_REQUIRE(settings.batchSize > 0, "the batch size must be > 0");
+	QL_REQUIRE(nTimeSteps > 0 || settings.observationGrid,
+		"the number of steps must be > 0 on a uniform grid");
+	QL_REQUIRE(smoothing > 0.0, "the smoothing width must be positive");
+
+	std::vector<Repayment> repayments = buildRepayments();
+	TimeGrid grid = simulationGrid(nTimeSteps, repayments, settings);
+
+	Size nBatches = (nSamples + settings.batchSize - 1) / settings.batchSize;
+	Size nThreads = settings.nThreads > 0 ? settings.nThreads : defaultThreads();
+	nThreads = std::min(nThreads, nBatches);
+	Size maxBatch = std::min(settings.batchSize, nSamples);
+
+	std::cout << "\nCalcolo delle greche con il modello di Black&Scholes...\n" << std::endl;
+
+	// the paths are evolved by the kernel, the same for every worker since
+	// it only reads the process; pricers and buffers are per worker
+	auto Mydiffusion = choseDiffusion('B', underlying_, qTermStructure_, OISTermStructure_, volatility_);
+	Mydiffusion->diffusion(0.0, Mydiffusion->initialValues());
+	PathKernel kernel(Mydiffusion, grid);
+
+	std::vector<boost::shared_ptr<AutocallablePathPricer>> pathPricers;
+	std::vector<PathArena> arenas;
+	for (Size i = 0; i < nThreads; i++) {
+		pathPricers.push_back(boost::shared_ptr<AutocallablePathPricer>(
+			new AutocallablePathPricer(bondTermStructure_, OISTermStructure_, maturity_,
+				strike_, settlementDate_, repayments, grid)));
+		arenas.push_back(PathArena(kernel.dimension(), grid.size(), maxBatch));
+	}
+	const std::vector<Size>& observationIndices = pathPricers[0]->observationIndices();
+	Size nObservations = observationIndices.size();
+	std::vector<std::vector<Real> > gradients(nThreads, std::vector<Real>(nObservations));
+
+	// the deterministic part of the log spot at the observation dates:
+	// log S(t) = log s0 + drifts(t) + sigma*W(t), with a flat volatility
+	Real s0 = underlying_->value();
+	Volatility sigma = volatility_->blackVol(grid.back(), s0);
+	std::vector<Time> times(nObservations);
+	std::vector<Real> drifts(nObservations);
+	for (Size j = 0; j < nObservations; j++) {
+		Time t = grid[observationIndices[j]];
+		times[j] = t;
+		drifts[j] = std::log(qTermStructure_->discount(t) / OISTermStructure_->discount(t))
+			- 0.5 * sigma * sigma * t;
+	}
+	Size first = std::min_element(observationIndices.begin(), observationIndices.end())
+		- observationIndices.begin();
+	QL_REQUIRE(times[first] > 0.0, "the first observation must follow the settlement");
+
+	// per batch: price, delta, gamma and vega of the paths
+	enum { PriceSample, DeltaSample, GammaSample, VegaSample, Estimates };
+	std::vector<std::vector<Statistics> > batchAccumulators(nBatches, std::vector<Statistics>(Estimates));
+	for (Size b = 0; b < nBatches; b++)
+		for (Size e = 0; e < Estimates; e++)
+			batchAccumulators[b][e].reserve(std::min(settings.batchSize, nSamples - b * settings.batchSize));
+
+	runBatches(nBatches, nThreads, [&](Size batch, Size worker) {
+		Size batchSamples = std::min(settings.batchSize, nSamples - batch * settings.batchSize);
+		PseudoRandom::rsg_type rsg = PseudoRandom::make_sequence_generator(kernel.dimension(),
+			streamSeed(settings.seed, batch));
+
+		PathArena& arena = arenas[worker];
+		const AutocallablePathPricer& pricer = *pathPricers[worker];
+		Real* gradient = &gradients[worker][0];
+		std::vector<Statistics>& accumulators = batchAccumulators[batch];
+
+		arena.draw(rsg, batchSamples);
+		kernel.evolve(&arena.normals[0], batchSamples, &arena.spots[0], &arena.workspace[0]);
+		for (Size p = 0; p < batchSamples; p++) {
+			const Real* spots = &arena.spots[p];
+			Real price = pricer.price(spots, batchSamples);
+			pricer.smoothedPrice(spots, batchSamples, smoothing, gradient);
+
+			Real delta = 0.0, vega = 0.0;
+			for (Size j = 0; j < nObservations; j++) {
+				Real stock = spots[observationIndices[j] * batchSamples];
+				// sigma*W(t) - sigma^2*t
+				Real shock = std::log(stock / s0) - drifts[j] - sigma * sigma * times[j];
+				delta += gradient[j] * stock;
+				vega += gradient[j] * stock * shock;
+			}
+			delta /= s0;
+			vega /= sigma;
 
-void AutocallableSimulation::compute(Size nTimeSteps, Size nSamples, char modelType) {
+			Real firstStock = spots[observationIndices[first] * batchSamples];
+			Real brownian = (std::log(firstStock / s0) - drifts[first]) / sigma;
+			Real score = brownian / (s0 * sigma * times[first]);
+			Real gamma = delta * (score - 1.0 / s0);
+
+			accumulators[PriceSample].add(price);
+			accumulators[DeltaSample].add(delta);
+			accumulators[GammaSample].add(gamma);
+			accumulators[VegaSample].add(vega);
+		}
+	});
+
+	// the batches are merged in batch order
+	std::vector<Statistics> estimates(Estimates);
+	for (Size b = 0; b < nBatches; b++)
+		for (Size e = 0; e < Estimates; e++)
+			mergeStatistics(estimates[e], batchAccumulators[b][e]);
+
+	const char* names[Estimates] = { "Price", "Delta", "Gamma", "Vega" };
+	std::cout << std::fixed << std::setw(8) << " " << " | " << std::setw(12) << "valore"
+		<< " | " << std::setw(10) << "errore" << "\n" << std::string(36, '-') << "\n";
+	for (Size e = 0; e < Estimates; e++)
+		std::cout << std::setw(8) << names[e] << " | "
+			<< std::setw(12) << std::setprecision(4) << estimates[e].mean() << " | "
+			<< std::setw(10) << std::setprecision(4) << estimates[e].errorEstimate() << "\n";
+	std::cout << "(smoothing " << smoothing * 100 << "% dei livelli)" << std::endl;
+}
+
+// The gradient of the smoothed price checked against finite differences:
+// on each path, the spot of every observation grid point is bumped up and
+// down and the central difference is refined by Richardson extrapolation,
+// whose error, of order h^4, is well below the tolerance.
+void AutocallableSimulation::checkGreeks(Size nPaths, Real smoothing, Real tolerance) {
+
+	QL_REQUIRE(nPaths > 0, "the number of paths must be > 0");
+
+	AutocallableSettings settings;
+	settings.observationGrid = true;
+	std::vector<Repayment> repayments = buildRepayments();
+	TimeGrid grid = simulationGrid(0, repayments, settings);
+
+	auto Mydiffusion = choseDiffusion('B', underlying_, qTermStructure_, OISTermStructure_, volatility_);
+	Mydiffusion->diffusion(0.0, Mydiffusion->initialValues());
+	PathKernel kernel(Mydiffusion, grid);
+	PathArena arena(kernel.dimension(), grid.size(), nPaths);
+	PseudoRandom::rsg_type rsg = PseudoRandom::make_sequence_generator(kernel.dimension(), settings.seed);
+	arena.draw(rsg, nPaths);
+	kernel.evolve(&arena.normals[0], nPaths, &arena.spots[0], &arena.workspace[0]);
+
+	AutocallablePathPricer pricer(bondTermStructure_, OISTermStructure_, maturity_, strike_,
+		settlementDate_, repayments, grid);
+	const std::vector<Size>& observationIndices = pricer.observationIndices();
+	std::vector<Real> gradient(observationIndices.size());
+	std::vector<Real> spots(grid.size());
+
+	// the derivative with respect to a grid point adds up those of the
+	// observations falling on it
+	std::vector<Size> points(observationIndices);
+	std::sort(points.begin(), points.end());
+	points.erase(std::unique(points.begin(), points.end()), points.end());
+
+	Real maxError = 0.0;
+	for (Size p = 0; p < nPaths; p++) {
+		for (Size k = 0; k < grid.size(); k++)
+			spots[k] = arena.spots[k * nPaths + p];
+		pricer.smoothedPrice(&spots[0], 1, smoothing, &gradient[0]);
+
+		for (Size point : points) {
+			Real adjoint = 0.0;
+			for (Size j = 0; j < observationIndices.size(); j++)
+				if (observationIndices[j] == point)
+					adjoint += gradient[j];
+
+			Real spot = spots[point];
+			auto centralDifference = [&](Real h) {
+				spots[point] = spot + h;
+				Real up = pricer.smoothedPrice(&spots[0], 1, smoothing, &gradient[0]);
+				spots[point] = spot - h;
+				Real down = pricer.smoothedPrice(&spots[0], 1, smoothing, &gradient[0]);
+				spots[point] = spot;
+				return (up - down) / (2.0 * h);
+			};
+			Real h = 1.0e-3 * spot;
+			Real difference = (4.0 * centralDifference(0.5 * h) - centralDifference(h)) / 3.0;
+			maxError = std::max(maxError, std::fabs(difference - adjoint) / std::max<Real>(std::fabs(adjoint), 1.0));
+
+			// the bumps overwrote the gradient of the path
+			pricer.smoothedPrice(&spots[0], 1, smoothing, &gradient[0]);
+		}
+	}
+
+	std::cout << "\nVerifica del gradiente del prezzo smussato su " << nPaths << " traiettorie, "
+		<< points.size() << " date di osservazione" << std::endl;
+	std::cout << "massimo errore relativo rispetto alle differenze finite = "
+		<< std::scientific << std::setprecision(2) << maxError
+		<< " (tolleranza " << tolerance << ")" << std::endl;
+	QL_ENSURE(maxError < tolerance, "the gradient of the smoothed price differs from the finite differences by "
+		<< maxError);
+}
+
+// The adjoint sensitivities are those of the smoothed price of
+// computeGreeks(), on the same Black&Scholes paths. The tape's inputs are
+// the spot, the volatility and every deterministic quantity the paths and
+// the payoff read: the OIS and dividend discount factors on the grid, the
+// discounted repayments, plus and maturity coupon. Their adjoints come
+// from one backward sweep per path, each path being dropped from the tape
+// once swept; those of the market quotes follow by the chain rule.
+void AutocallableSimulation::computeSensitivities(Size nTimeSteps, Size nSamples,
+	const std::vector<boost::shared_ptr<SimpleQuote> >& OISQuotes,
+	const std::vector<boost::shared_ptr<SimpleQuote> >& bondQuotes,
+	const AutocallableSettings& settings, Real smoothing) {
+
+	QL_REQUIRE(nSamples > 0, "the number of samples must be > 0");
+	QL_REQUIRE(settings.batchSize > 0, "the batch size must be > 0");
+	QL_REQUIRE(nTimeSteps > 0 || settings.observationGrid,
+		"the number of steps must be > 0 on a uniform grid");
+	QL_REQUIRE(smoothing > 0.0, "the smoothing width must be positive");
+
+	std::vector<Repayment> repayments = buildRepayments();
+	TimeGrid grid = simulationGrid(nTimeSteps, repayments, settings);
+	Size nSteps = grid.size() - 1;
+	Size nRepayments = repayments.size();
+
+	Size nBatches = (nSamples + settings.batchSize - 1) / settings.batchSize;
+	Size nThreads = settings.nThreads > 0 ? settings.nThreads : defaultThreads();
+	nThreads = std::min(nThreads, nBatches);
+	Size maxBatch = std::min(settings.batchSize, nSamples);
+
+	std::cout << "\nSensitivita' adjoint con il modello di Black&Scholes...\n" << std::endl;
+
+	// the quantities read by the paths, as functions of the curves: OIS
+	// and dividend discount factors on the grid, repayment values, plus and
+	// maturity coupon
+	auto deterministicInputs = [&]() {
+		std::vector<Real> values;
+		for (Size k = 0; k <= nSteps; k++)
+			values.push_back(OISTermStructure_->discount(grid[k]));
+		for (Size k = 0; k <= nSteps; k++)
+			values.push_back(qTermStructure_->discount(grid[k]));
+		std::vector<Repayment> current = buildRepayments();
+		for (auto const& r : current)
+			values.push_back(r.value);
+		AutocallablePathPricer pricer(bondTermStructure_, OISTermStructure_, maturity_,
+			strike_, settlementDate_, current, grid);
+		values.push_back(pricer.plusValue());
+		values.push_back(pricer.maturityCouponValue());
+		return values;
+	};
+
+	Real s0 = underlying_->value();
+	Volatility sigma = volatility_->blackVol(grid.back(), s0);
+	std::vector<Real> inputs(1, s0);
+	inputs.push_back(sigma);
+	std::vector<Real> deterministic = deterministicInputs();
+	inputs.insert(inputs.end(), deterministic.begin(), deterministic.end());
+	Size nInputs = inputs.size();
+
+	std::vector<boost::shared_ptr<AutocallablePathPricer>> pathPricers;
+	std::vector<PathArena> arenas;
+	for (Size i = 0; i < nThreads; i++) {
+		pathPricers.push_back(boost::shared_ptr<AutocallablePathPricer>(
+			new AutocallablePathPricer(bondTermStructure_, OISTermStructure_, maturity_,
+				strike_, settlementDate_, repayments, grid)));
+		arenas.push_back(PathArena(nSteps, grid.size(), maxBatch));
+	}
+	std::vector<Tape> tapes(nThreads);
+	std::vector<std::vector<Number> > spotBuffers(nThreads, std::vector<Number>(grid.size()));
+
+	// per batch: the sum of the prices and of the adjoints of the inputs,
+	// each batch being recorded on a cleared tape
+	std::vector<Real> batchPrices(nBatches, 0.0);
+	std::vector<std::vector<Real> > batchAdjoints(nBatches, std::vector<Real>(nInputs, 0.0));
+	std::vector<Size> tapeSizes(nThreads, 0);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	runBatches(nBatches, nThreads, [&](Size batch, Size worker) {
+		Size batchSamples = std::min(settings.batchSize, nSamples - batch * settings.batchSize);
+		PseudoRandom::rsg_type rsg = PseudoRandom::make_sequence_generator(nSteps,
+			streamSeed(settings.seed, batch));
+
+		Tape& tape = tapes[worker];
+		tape.clear();
+		ActiveTape activeTape(tape);
+
+		std::vector<Number> variables;
+		variables.reserve(nInputs);
+		for (Size j = 0; j < nInputs; j++)
+			variables.push_back(Number::variable(inputs[j]));
+		const Number* r = &variables[2];
+		const Number* q = r + nSteps + 1;
+		const Number* values = q + nSteps + 1;
+		const Number& plusValue = values[nRepayments];
+		const Number& maturityCouponValue = values[nRepayments + 1];
+
+		// the exact log-normal steps of the grid, shared by all the paths
+		std::vector<Number> growths, shocks;
+		for (Size k = 0; k < nSteps; k++) {
+			shocks.push_back(variables[1] * std::sqrt(grid.dt(k)));
+			growths.push_back(r[k] / r[k + 1] * (q[k + 1] / q[k]) * exp(-0.5 * shocks[k] * shocks[k]));
+		}
+		tape.mark();
+
+		PathArena& arena = arenas[worker];
+		const AutocallablePathPricer& pricer = *pathPricers[worker];
+		std::vector<Number>& spots = spotBuffers[worker];
+
+		arena.draw(rsg, batchSamples);
+		Real sum = 0.0;
+		for (Size p = 0; p < batchSamples; p++) {
+			spots[0] = variables[0];
+			for (Size k = 0; k < nSteps; k++)
+				spots[k + 1] = spots[k] * growths[k] * exp(shocks[k] * arena.normals[k * batchSamples + p]);
+			Number price = pricer.smoothedPrice(&spots[0], 1, smoothing, values,
+				plusValue, maturityCouponValue);
+
+			sum += price.value();
+			tapeSizes[worker] = std::max(tapeSizes[worker], tape.size());
+			tape.adjoint(price.index()) += 1.0;
+			tape.propagateToMark();
+			tape.rewindToMark();
+		}
+		tape.propagateToStart();
+
+		batchPrices[batch] = sum;
+		for (Size j = 0; j < nInputs; j++)
+			batchAdjoints[batch][j] = tape.adjoint(variables[j].index());
+	});
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	// the batches are added in batch order
+	Real price = 0.0;
+	std::vector<Real> gradient(nInputs, 0.0);
+	for (Size b = 0; b < nBatches; b++) {
+		price += batchPrices[b] / nSamples;
+		for (Size j = 0; j < nInputs; j++)
+			gradient[j] += batchAdjoints[b][j] / nSamples;
+	}
+	std::vector<Real> deterministicAdjoints(gradient.begin() + 2, gradient.end());
+
+	std::cout << std::fixed << std::setprecision(4)
+		<< "Price    " << std::setw(12) << price << "\n"
+		<< "Delta    " << std::setw(12) << gradient[0] << "\n"
+		<< "Vega     " << std::setw(12) << gradient[1] << "\n"
+		<< "(smoothing " << smoothing * 100 << "% dei livelli, "
+		<< *std::max_element(tapeSizes.begin(), tapeSizes.end()) << " nodi per percorso, "
+		<< std::setprecision(2) << elapsed.count() << " s)" << std::endl;
+
+	std::cout << "per punto base delle quotazioni OIS:" << std::endl;
+	printSensitivities("OIS quote", chainRule(quoteJacobian(OISQuotes, deterministicInputs, 1.0e-5),
+		deterministicAdjoints), 1.0e-4);
+	std::cout << "per 0.01 di prezzo delle obbligazioni:" << std::endl;
+	printSensitivities("bond quote", chainRule(quoteJacobian(bondQuotes, deterministicInputs, 1.0e-3),
+		deterministicAdjoints), 0.01);
+}
+
+// The micro-benchmark prices the same set of paths with the
+// AutocallablePathPricer and with the original, date-based one.
+void AutocallableSimulation::benchmarkPricer(Size nTimeSteps, Size nPaths, char modelType) {
+
+	QL_REQUIRE(nTimeSteps > 0, "the number of steps must be > 0");
+	QL_REQUIRE(nPaths > 0, "the number of paths must be > 0");
+
+	std::vector<Repayment> repayments = buildRepayments();
+	TimeGrid grid(maturity_, nTimeSteps);
+
+	// the paths are generated once and kept in memory,
+	// so that only the pricing is timed
+	boost::shared_ptr<LocalVolTermStructure> localVolatilityTable;
+	if (modelType == 'L')
+		localVolatilityTable = tabulatedLocalVolatility(underlying_, qTermStructure_,
+			OISTermStructure_, impliedVolatility_, grid.back());
+	auto Mydiffusion = choseDiffusion(modelType, underlying_, qTermStructure_, OISTermStructure_, volatility_,
+		localVolatilityTable);
+	PseudoRandom::rsg_type rsg = PseudoRandom::make_sequence_generator(Mydiffusion->factors() * nTimeSteps, 1234);
+	typedef MultiVariate<PseudoRandom>::path_generator_type generator_type;
+	generator_type generator(Mydiffusion, grid, rsg, false);
+
+	std::vector<MultiPath> paths;
+	paths.reserve(nPaths);
+	for (Size i = 0; i < nPaths; i++)
+		paths.push_back(generator.next().value);
+
+	AutocallablePathPricer pricer(bondTermStructure_, OISTermStructure_, maturity_, strike_,
+		settlementDate_, repayments, grid);
+	ReferencePathPricer reference(OISTermStructure_, strike_, settlementDate_, repayments);
+
+	Real referencePrice, price;
+	Real referenceTime = nanosecondsPerPath(reference, paths, referencePrice);
+	Real time = nanosecondsPerPath(pricer, paths, price);
+
+	std::cout << std::fixed << std::setprecision(1)
+		<< "\nPath pricer on " << nPaths << " paths of " << nTimeSteps << " steps\n"
+		<< std::setw(12) << "pricer" << " | " << std::setw(10) << "ns/path" << " | " << std::setw(10) << "price" << "\n"
+		<< std::string(40, '-') << "\n"
+		<< std::setw(12) << "reference" << " | " << std::setw(10) << referenceTime << " | " << std::setw(10) << std::setprecision(4) << referencePrice << "\n"
+		<< std::setprecision(1)
+		<< std::setw(12) << "index table" << " | " << std::setw(10) << time << " | " << std::setw(10) << std::setprecision(4) << price << "\n"
+		<< "\nSpeed-up = " << std::setprecision(1) << referenceTime / time << "x" << std::endl;
+}
+
+std::vector<Repayment> AutocallableSimulation::buildRepayments() const {
 
 	Real excerciselevel = 15.08;
 
@@ -85,45 +807,55 @@ void AutocallableSimulation::compute(Size nTimeSteps, Size nSamples, char modelT
 		auto value = repaymentValue(r, OISTermStructure_, bondTermStructure_);
 		r.value = value;
 	}
-	
-	// The Monte Carlo model generates paths, according to the "diffusion process", 
-	//using the PathGenerator
-	// each path is priced using thePathPricer
-	// prices will be accumulated into statisticsAccumulator
 
-	auto Mydiffusion = choseDiffusion(modelType,underlying_,qTermStructure_,OISTermStructure_,volatility_);
+	return repayments;
+}
 
-	const BigNatural seed = 1234;
-	PseudoRandom::rsg_type rsg = PseudoRandom::make_sequence_generator(Mydiffusion->factors() * nTimeSteps, seed);
 
-	typedef MultiVariate<PseudoRandom>::path_generator_type generator_type;
-	boost::shared_ptr<generator_type> MyPathGenerator(new
-		generator_type(Mydiffusion, TimeGrid(maturity_, nTimeSteps),
-			rsg, false));
-
-	boost::shared_ptr<PathPricer<MultiPath>> MyPathPricer(
-		new AutocallablePathPricer(bondTermStructure_,
-			OISTermStructure_,
-			maturity_,
-			strike_,
-			settlementDate_,
-			repayments));
+AutocallableTermSheet AutocallableSimulation::termSheet() const {
+	AutocallableTermSheet termSheet = { "certificato", strike_, 9.0504, 58.0, buildRepayments() };
+	return termSheet;
+}
 
-	Statistics statisticsAccumulator;
+boost::shared_ptr<LocalVolTermStructure> tabulatedLocalVolatility(boost::shared_ptr<Quote> underlying,
+	boost::shared_ptr<YieldTermStructure> qTermStructure,
+	boost::shared_ptr<YieldTermStructure> OISTermStructure,
+	boost::shared_ptr<BlackVolTermStructure> impliedVolatility,
+	Time horizon) {
+
+	QL_REQUIRE(impliedVolatility, "the local volatility model needs the implied volatility surface");
 
-	MonteCarloModel<MultiVariate, PseudoRandom>
-		MCSimulation(MyPathGenerator,
-			MyPathPricer,
-			statisticsAccumulator,
-			false);
+	// 50 dates a year, and 500 spots within 5 standard deviations of the
+	// log spot at the horizon
+	Real s0 = underlying->value();
+	Real width = 5.0 * impliedVolatility->blackVol(horizon, s0, true) * std::sqrt(horizon);
+	Size nTimes = std::max<Size>(Size(std::ceil(50.0 * horizon)), 1);
 
-	MCSimulation.addSamples(nSamples);
+	boost::shared_ptr<CachedLocalVolSurface> table(new CachedLocalVolSurface(
+		Handle<BlackVolTermStructure>(impliedVolatility),
+		Handle<YieldTermStructure>(OISTermStructure),
+		Handle<YieldTermStructure>(qTermStructure),
+		Handle<Quote>(underlying),
+		horizon, nTimes, s0 * std::exp(-width), s0 * std::exp(width), 500));
+	if (table->fallbacks() > 0)
+		std::cout << "volatilita' locale: varianza negativa in " << table->fallbacks() << " nodi su "
+			<< table->nodes() << ", sostituita dalla volatilita' implicita" << std::endl;
+	return table;
+}
 
-	Real Price = MCSimulation.sampleAccumulator().mean();
+Real europeanPutValue(char modelType,
+	const boost::shared_ptr<StochasticProcess>& diffusion,
+	Real strike, Time time) {
 
-	std::cout << " \nQuotazione = " << 1005.32 << std::endl;
-	std::cout << " \nPrice = " << Price << std::endl;
-	std::cout << " \nErrore = " << abs(1-Price/ 1005.32) * 100 << " % " << std::endl;
+	//Black's formula, on the volatility of the process
+	if (modelType != 'B')
+		return Null<Real>();
+	auto process = boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(diffusion);
+	QL_REQUIRE(process, "Black&Scholes process expected");
+	DiscountFactor discount = process->riskFreeRate()->discount(time);
+	Real forward = process->x0() * process->dividendYield()->discount(time) / discount;
+	Real variance = process->blackVolatility()->blackVariance(time, strike, true);
+	return BlackCalculator(Option::Put, strike, forward, std::sqrt(variance), discount).value();
 }
 
 Real repaymentValue(const Repayment& repayment,
@@ -141,7 +873,8 @@ boost::shared_ptr<StochasticProcess> choseDiffusion(char modelType,
 	boost::shared_ptr<Quote>(underlying),
 	boost::shared_ptr<YieldTermStructure>(qTermStructure),
 	boost::shared_ptr<YieldTermStructure>(OISTermStructure),
-	boost::shared_ptr<BlackVolTermStructure>(volatility)) {
+	boost::shared_ptr<BlackVolTermStructure>(volatility),
+	boost::shared_ptr<LocalVolTermStructure>(localVolatility)) {
 
 	//B&S model
 	boost::shared_ptr<StochasticProcess> BSdiffusion(new BlackScholesMertonProcess(
@@ -169,13 +902,43 @@ boost::shared_ptr<StochasticProcess> choseDiffusion(char modelType,
 	switch (modelType)
 	{
 	case ('B'):		
-		std::cout << "\nCalcolo del prezzo con il modello di Black&Scholes...\n" << std::endl;
 		return BSdiffusion;
-		break;
 
 	case('H'):
-		std::cout << "\nCalcolo del prezzo con il modello di Heston...\n" << std::endl;		
 		return Hdiffusion;
-		break;
+
+	//local volatility model, on the tabulated Dupire surface
+	case('L'):
+		QL_REQUIRE(localVolatility, "no local volatility surface given");
+		return boost::shared_ptr<StochasticProcess>(new GeneralizedBlackScholesProcess(
+			Handle<Quote>(underlying),
+			Handle<YieldTermStructure>(qTermStructure),
+			Handle<YieldTermStructure>(OISTermStructure),
+			Handle<BlackVolTermStructure>(volatility),
+			Handle<LocalVolTermStructure>(localVolatility)));
+
+	default:
+		QL_FAIL("unknown model type " << modelType);
 	}
-}
\ No newline at end of file
+}
+
+// Average time, in nanoseconds, taken by the pricer on one of the paths.
+// The paths are priced over and over until at least half a second is spent.
+Real nanosecondsPerPath(const PathPricer<MultiPath>& pricer,
+	const std::vector<MultiPath>& paths, Real& meanPrice) {
+
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	clock::duration elapsed;
+	Size passes = 0;
+	Real sum = 0.0;
+	do {
+		for (auto const& path : paths)
+			sum += pricer(path);
+		passes++;
+		elapsed = clock::now() - start;
+	} while (elapsed < std::chrono::milliseconds(500));
+
+	meanPrice = sum / (passes * paths.size());
+	return std::chrono::duration<Real, std::nano>(elapsed).count() / (passes * paths.size());
+}
@@ -3,9 +3,74 @@
 #define autocallable_simulation_hpp
 
 #include <ql/quantlib.hpp>
+#include <pathkernel.hpp>
 
 using namespace QuantLib;
 
+struct Repayment {
+	Real faceAmount;
+	Real coupon;
+	Real value;
+	std::vector<Date> evaluationDates;
+	Real exerciseLevel;
+	Date paymentDate;
+};
+
+// the terms of a certificate: its repayments, the starting level the stock
+// performance is measured from, the knock-in barrier at maturity and the
+// plus paid on the first payment date
+struct AutocallableTermSheet {
+	std::string name;
+	Real startingLevel;
+	Real barrierLevel;
+	Real plus;
+	std::vector<Repayment> repayments;
+};
+
+// Monte Carlo settings of the price computation
+struct AutocallableSettings {
+	AutocallableSettings() : nThreads(0), batchSize(1000), seed(1234), observationGrid(false),
+		pathKernel(false), quasiRandom(false), scrambles(0), brownianBridge(true),
+		antithetic(false), controlVariate(false), hestonScheme(QuadraticExponentialScheme) {}
+
+	// worker threads pricing the batches (0 = all the cores)
+	Size nThreads;
+	// samples per batch; each batch draws from its own random stream
+	Size batchSize;
+	// master seed the batch streams are derived from: for a given seed and
+	// batch size the price does not depend on the number of threads
+	BigNatural seed;
+	// simulate the observation dates only, instead of a uniform grid up to
+	// maturity; nTimeSteps then bounds the step size (T/nTimeSteps) and can
+	// be 0 when the diffusion is exact over any step, as for Black&Scholes
+	bool observationGrid;
+	// evolve each batch as a block with the vectorised PathKernel instead
+	// of QuantLib's path generator; the draws are the same
+	bool pathKernel;
+	// draw from a Sobol sequence instead of the Mersenne Twister
+	// (needs the path kernel)
+	bool quasiRandom;
+	// independent Owen scrambles of the Sobol sequence, each one pricing
+	// nSamples/scrambles paths; their spread gives the randomised-QMC
+	// error (0 = plain Sobol sequence, no error estimate)
+	Size scrambles;
+	// build the quasi-random paths with a Brownian bridge
+	bool brownianBridge;
+	// each sample averages a path and its antithetic one, so that nSamples
+	// samples take 2*nSamples paths
+	bool antithetic;
+	// control the prices with a European payoff on the spot at the end of
+	// the grid, whose mean under the simulated paths is known exactly: a put
+	// struck at the starting level under Black&Scholes, the discounted spot
+	// under the other models (see europeanPutValue())
+	bool controlVariate;
+	// discretization of the Heston paths evolved by the path kernel; the
+	// quadratic-exponential scheme, accurate with about 50 steps a year, is
+	// the one of QuantLib's generator, so that turning the kernel on does
+	// not change the Heston prices beyond the Monte Carlo error
+	HestonScheme hestonScheme;
+};
+
 /* The AutocallableSimulation class carries out Monte Carlo simulations to evaluate
 the price of the Investment Certificate taking into accoutn the autocallable event over
 different, randomly generated scenarios of future stock price evolution.
@@ -20,29 +85,102 @@ public:
 		boost::shared_ptr<BlackVolTermStructure> volatility,
 		Time maturity,
 		Real strike,
-		Date settlementDate);
+		Date settlementDate,
+		boost::shared_ptr<BlackVolTermStructure> impliedVolatility = boost::shared_ptr<BlackVolTermStructure>());
+
+	// the actual price computation over the MC scenario; the model is
+	// 'B' for Black&Scholes, 'H' for Heston, 'L' for the Dupire local
+	// volatility of the implied surface
+	void compute(Size nTimeSteps, Size nSamples, char modelType,
+		const AutocallableSettings& settings = AutocallableSettings());
+
+	// the price computation in batches of batchSize paths, in place of
+	// settings.batchSize, added until the standard error of the price is
+	// below absErr or maxSamples samples are reached; a convergence trace
+	// is printed along the way
+	void computeToTolerance(Real absErr, Size maxSamples, Size batchSize, Size nTimeSteps,
+		char modelType, const AutocallableSettings& settings = AutocallableSettings());
+
+	// price, delta, gamma and vega under Black&Scholes in a single pass,
+	// from pathwise and likelihood ratio estimators on a payoff whose
+	// autocall triggers and barrier are smoothed over a relative width
+	// `smoothing` of their levels
+	void computeGreeks(Size nTimeSteps, Size nSamples,
+		const AutocallableSettings& settings = AutocallableSettings(), Real smoothing = 0.01);
 
-	// the actual price computation over the MC scenario
-	void compute(Size nTimeSteps, Size nSamples, char modelType);
+	// check of the gradient of the smoothed price behind computeGreeks()
+	// against finite differences, on nPaths Black&Scholes paths: fails if
+	// the largest relative difference reaches the tolerance
+	void checkGreeks(Size nPaths, Real smoothing = 0.01, Real tolerance = 1.0e-7);
+
+	// adjoint (AAD) sensitivities of the same smoothed price to the spot,
+	// the volatility and, by the chain rule, to the OIS and bond quotes the
+	// curves are bootstrapped on, from one backward sweep per path
+	void computeSensitivities(Size nTimeSteps, Size nSamples,
+		const std::vector<boost::shared_ptr<SimpleQuote> >& OISQuotes,
+		const std::vector<boost::shared_ptr<SimpleQuote> >& bondQuotes,
+		const AutocallableSettings& settings = AutocallableSettings(), Real smoothing = 0.01);
+
+	// the terms of the certificate, its repayments valued on the curves
+	AutocallableTermSheet termSheet() const;
+
+	// micro-benchmark of the per-path cost of the path pricer
+	void benchmarkPricer(Size nTimeSteps, Size nPaths, char modelType);
 
 private:
+	// the simulation behind compute() and computeToTolerance(); a null
+	// absErr prices all the nSamples samples
+	void simulate(Size nTimeSteps, Size nSamples, char modelType,
+		const AutocallableSettings& settings, Real absErr);
+
+	TimeGrid simulationGrid(Size nTimeSteps, const std::vector<Repayment>& repayments,
+		const AutocallableSettings& settings) const;
+
+	// the certificate's repayments, valued on the bond and OIS curves
+	std::vector<Repayment> buildRepayments() const;
+
 	boost::shared_ptr<Quote> underlying_;
 	boost::shared_ptr<YieldTermStructure> qTermStructure_;
 	boost::shared_ptr<YieldTermStructure> bondTermStructure_;
 	boost::shared_ptr<YieldTermStructure> OISTermStructure_;
 	boost::shared_ptr<BlackVolTermStructure> volatility_;
+	boost::shared_ptr<BlackVolTermStructure> impliedVolatility_;
 	Time maturity_;
 	Real strike_;
 	Date settlementDate_;
 };
 
-struct Repayment {
-	Real faceAmount;
-	Real coupon;
-	Real value;
-	std::vector<Date> evaluationDates;
-	Real exerciseLevel;
-	Date paymentDate;
-};
+// value of a repayment: its face amount on the bond curve, its coupon on
+// the risk-free curve
+Real repaymentValue(const Repayment& repayment,
+	boost::shared_ptr<YieldTermStructure> riskFreeTermStructure,
+	boost::shared_ptr<YieldTermStructure> riskyTermStructure);
+
+// value of the European put on the spot, struck at strike and expiring at
+// time, by Black's formula on the Black&Scholes diffusion given, whose
+// paths are exact over any step. Null<Real>() for the other models: their
+// discretized paths (the Euler steps on the Dupire table, the QE or Euler
+// Heston steps) do not reprice the closed forms of the continuous models,
+// whereas their discounted spot stays an exact martingale.
+Real europeanPutValue(char modelType,
+	const boost::shared_ptr<StochasticProcess>& diffusion,
+	Real strike, Time time);
+
+// the diffusion of the given model type; the local volatility surface is
+// needed by the model 'L' only
+boost::shared_ptr<StochasticProcess> choseDiffusion(char modelType,
+	boost::shared_ptr<Quote>(underlying),
+	boost::shared_ptr<YieldTermStructure>(qTermStructure),
+	boost::shared_ptr<YieldTermStructure>(OISTermStructure),
+	boost::shared_ptr<BlackVolTermStructure>(volatility),
+	boost::shared_ptr<LocalVolTermStructure>(localVolatility) = boost::shared_ptr<LocalVolTermStructure>());
+
+// the Dupire local volatility of the implied surface up to the horizon,
+// tabulated once for all the paths
+boost::shared_ptr<LocalVolTermStructure> tabulatedLocalVolatility(boost::shared_ptr<Quote> underlying,
+	boost::shared_ptr<YieldTermStructure> qTermStructure,
+	boost::shared_ptr<YieldTermStructure> OISTermStructure,
+	boost::shared_ptr<BlackVolTermStructure> impliedVolatility,
+	Time horizon);
 
 #endif
\ No newline at end of file
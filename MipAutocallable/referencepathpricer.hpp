@@ -0,0 +1,30 @@
+#pragma once
+#ifndef reference_path_pricer_hpp
+#define reference_path_pricer_hpp
+
+#include <ql/quantlib.hpp>
+#include <autocallablesimulation.hpp>
+
+using namespace QuantLib;
+
+// The original AutocallablePathPricer, which converts every observation
+// date to a time and searches the path's grid for it on each path.
+// It is kept as the baseline of the path pricer micro-benchmark.
+
+class ReferencePathPricer : public PathPricer<MultiPath> {
+public:
+	ReferencePathPricer(boost::shared_ptr<YieldTermStructure> OISTermStructure,
+		Real strike,
+		Date settlementDate,
+		std::vector<Repayment> repayments);
+
+	Real operator()(const MultiPath& paths) const;
+
+private:
+	boost::shared_ptr<YieldTermStructure> OISTermStructure_;
+	Real strike_;
+	Date settlementDate_;
+	std::vector<Repayment> repayments_;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include <ql/quantlib.hpp>
+#include <termsheetreader.hpp>
+#include <csvrecords.hpp>
+#include <fstream>
+
+using namespace QuantLib;
+
+TermSheetReader::TermSheetReader(std::istream& in, const std::string& source, const Date& settlementDate)
+	: in_(in), source_(source), settlementDate_(settlementDate), line_(0), pendingLine_(0) {}
+
+bool TermSheetReader::next(AutocallableTermSheet& termSheet) {
+
+	// the product line, read ahead by the previous call or the next record
+	std::vector<std::string> fields;
+	Size productLine;
+	if (!pending_.empty()) {
+		fields.swap(pending_);
+		productLine = pendingLine_;
+	}
+	else {
+		if (!readRecord(in_, fields, line_))
+			return false;
+		productLine = line_;
+	}
+
+	try {
+		QL_REQUIRE(fields[0] == "product", "product line expected, '" << fields[0] << "' found");
+		QL_REQUIRE(fields.size() == 5, "a product line has 5 fields, " << fields.size() << " found");
+		QL_REQUIRE(!fields[1].empty(), "the product has no name");
+		termSheet.name = fields[1];
+		termSheet.startingLevel = parseReal(fields[2], "starting level");
+		termSheet.barrierLevel = parseReal(fields[3], "barrier level");
+		termSheet.plus = parseReal(fields[4], "plus");
+		termSheet.repayments.clear();
+	}
+	catch (std::exception& e) {
+		QL_FAIL(source_ << ", line " << productLine << ": " << e.what());
+	}
+
+	// its repayments, up to the next product line
+	while (readRecord(in_, fields, line_)) {
+		if (fields[0] == "product") {
+			pending_.swap(fields);
+			pendingLine_ = line_;
+			break;
+		}
+		try {
+			QL_REQUIRE(fields[0] == "repayment", "unknown record '" << fields[0] << "'");
+			QL_REQUIRE(fields.size() >= 6,
+				"a repayment line has at least 6 fields, " << fields.size() << " found");
+			Repayment repayment;
+			repayment.faceAmount = parseReal(fields[1], "face amount");
+			repayment.coupon = parseReal(fields[2], "coupon");
+			repayment.exerciseLevel = parseReal(fields[3], "exercise level");
+			repayment.paymentDate = parseDate(fields[4]);
+			repayment.value = 0.0;
+			for (Size i = 5; i < fields.size(); i++)
+				repayment.evaluationDates.push_back(parseDate(fields[i]));
+			termSheet.repayments.push_back(repayment);
+		}
+		catch (std::exception& e) {
+			QL_FAIL(source_ << ", line " << line_ << ": " << e.what());
+		}
+	}
+
+	try {
+		validateTermSheet(termSheet, settlementDate_);
+	}
+	catch (std::exception& e) {
+		QL_FAIL(source_ << ", line " << productLine << " (" << termSheet.name << "): " << e.what());
+	}
+	return true;
+}
+
+void validateTermSheet(const AutocallableTermSheet& termSheet, const Date& settlementDate) {
+	QL_REQUIRE(termSheet.startingLevel > 0.0, "the starting level must be positive");
+	QL_REQUIRE(termSheet.barrierLevel > 0.0, "the barrier level must be positive");
+	QL_REQUIRE(termSheet.plus >= 0.0, "the plus cannot be negative");
+	QL_REQUIRE(!termSheet.repayments.empty(), "no repayments given");
+
+	Date lastObservation = settlementDate, lastPayment = settlementDate;
+	for (Size i = 0; i < termSheet.repayments.size(); i++) {
+		const Repayment& r = termSheet.repayments[i];
+		QL_REQUIRE(r.faceAmount > 0.0, "repayment " << i + 1 << ": the face amount must be positive");
+		QL_REQUIRE(r.coupon >= 0.0, "repayment " << i + 1 << ": the coupon cannot be negative");
+		QL_REQUIRE(r.exerciseLevel > 0.0, "repayment " << i + 1 << ": the exercise level must be positive");
+		QL_REQUIRE(!r.evaluationDates.empty(), "repayment " << i + 1 << ": no observation dates");
+		for (auto const& d : r.evaluationDates) {
+			QL_REQUIRE(d > lastObservation, "repayment " << i + 1 << ": observation date " << d
+				<< " not after " << lastObservation);
+			lastObservation = d;
+		}
+		QL_REQUIRE(r.paymentDate >= lastObservation && r.paymentDate > lastPayment,
+			"repayment " << i + 1 << ": payment date " << r.paymentDate
+			<< " before its observations or the previous payment");
+		lastPayment = r.paymentDate;
+	}
+}
+
+std::vector<AutocallableTermSheet> loadTermSheets(const std::string& fileName, const Date& settlementDate) {
+	std::ifstream in(fileName.c_str());
+	QL_REQUIRE(in, "cannot open the term sheet file " << fileName);
+
+	TermSheetReader reader(in, fileName, settlementDate);
+	std::vector<AutocallableTermSheet> termSheets;
+	AutocallableTermSheet termSheet;
+	while (reader.next(termSheet))
+		termSheets.push_back(termSheet);
+	QL_REQUIRE(!termSheets.empty(), "no term sheets in " << fileName);
+	return termSheets;
+}
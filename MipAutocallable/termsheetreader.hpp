@@ -0,0 +1,57 @@
+#pragma once
+#ifndef term_sheet_reader_hpp
+#define term_sheet_reader_hpp
+
+#include <ql/quantlib.hpp>
+#include <autocallablesimulation.hpp>
+#include <istream>
+
+using namespace QuantLib;
+
+/* Streaming reader of certificate term sheets in a compact CSV format.
+
+Each certificate is a product line followed by its repayment lines, in
+payment order:
+
+	product,<name>,<starting level>,<barrier level>,<plus>
+	repayment,<face amount>,<coupon>,<exercise level>,<payment date>,<observation dates>...
+
+the dates being given as yyyy-mm-dd. Blank lines and lines starting with
+'#' are skipped. The term sheets are read one at a time, so that a book of
+any size is parsed without keeping the file in memory, and each one is
+checked by validateTermSheet() as it is read: a malformed line or an
+invalid term sheet raises an error giving the source and the line. The
+values of the repayments are left null; the pricers value them on the
+curves.
+*/
+
+class TermSheetReader {
+public:
+	// source names the stream in the error messages
+	TermSheetReader(std::istream& in, const std::string& source, const Date& settlementDate);
+
+	// the next term sheet of the stream; false at its end
+	bool next(AutocallableTermSheet& termSheet);
+
+	// lines read so far
+	Size lines() const { return line_; }
+
+private:
+	std::istream& in_;
+	std::string source_;
+	Date settlementDate_;
+	Size line_;
+	// product line read ahead while looking for the end of the previous term sheet
+	std::vector<std::string> pending_;
+	Size pendingLine_;
+};
+
+// checks a term sheet: positive levels and amounts, at least one repayment,
+// observation dates after the settlement date, increasing within and
+// across the repayments and not later than their payment dates
+void validateTermSheet(const AutocallableTermSheet& termSheet, const Date& settlementDate);
+
+// all the term sheets of a file
+std::vector<AutocallableTermSheet> loadTermSheets(const std::string& fileName, const Date& settlementDate);
+
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#ifndef variance_reduction_hpp
+#define variance_reduction_hpp
+
+#include <ql/quantlib.hpp>
+
+using namespace QuantLib;
+
+/* Running sums of the prices of a batch and of their control variate.
+
+A sample is either a path or, with antithetic paths, the average over a
+path and its antithetic one. The samples are controlled with the
+regression coefficient beta = Cov(Y,C)/Var(C) estimated on the samples
+themselves. The prices of the single paths are kept apart, so that the
+variance of plain Monte Carlo over the same number of paths is known and
+the variance reduction achieved can be measured. The sums of the batches
+merge in any order.
+*/
+struct VarianceReductionSums {
+	VarianceReductionSums() : paths(0), pathSum(0.0), pathSquares(0.0), samples(0),
+		sumY(0.0), sumC(0.0), sumYY(0.0), sumCC(0.0), sumYC(0.0) {}
+
+	// the price of a single path, before any variance reduction
+	void addPath(Real price) {
+		++paths;
+		pathSum += price;
+		pathSquares += price * price;
+	}
+
+	// a sample and the value of its control
+	void addSample(Real y, Real c) {
+		++samples;
+		sumY += y;
+		sumC += c;
+		sumYY += y * y;
+		sumCC += c * c;
+		sumYC += y * c;
+	}
+
+	void merge(const VarianceReductionSums& other) {
+		paths += other.paths;
+		pathSum += other.pathSum;
+		pathSquares += other.pathSquares;
+		samples += other.samples;
+		sumY += other.sumY;
+		sumC += other.sumC;
+		sumYY += other.sumYY;
+		sumCC += other.sumCC;
+		sumYC += other.sumYC;
+	}
+
+	// optimal control coefficient
+	Real beta() const {
+		Real varC = sumCC - sumC * sumC / samples;
+		return varC > 0.0 ? (sumYC - sumY * sumC / samples) / varC : 0.0;
+	}
+
+	// the controlled estimate, controlValue being the known mean of the
+	// control (beta = 0 gives the plain sample mean)
+	Real mean(Real beta, Real controlValue) const {
+		return (sumY - beta * (sumC - samples * controlValue)) / samples;
+	}
+
+	// variance of a controlled sample Y - beta*C
+	Real variance(Real beta) const {
+		QL_REQUIRE(samples > 1, "at least two samples are needed");
+		Real n = Real(samples);
+		Real varY = sumYY - sumY * sumY / n;
+		Real varC = sumCC - sumC * sumC / n;
+		Real covYC = sumYC - sumY * sumC / n;
+		return std::max<Real>(varY - 2.0 * beta * covYC + beta * beta * varC, 0.0) / (n - 1.0);
+	}
+
+	Real errorEstimate(Real beta) const {
+		return std::sqrt(variance(beta) / samples);
+	}
+
+	// variance of the mean of plain Monte Carlo over the same paths,
+	// over the variance of the estimate
+	Real reductionFactor(Real beta) const {
+		QL_REQUIRE(paths > 1, "at least two paths are needed");
+		Real n = Real(paths);
+		Real pathVariance = (pathSquares - pathSum * pathSum / n) / (n - 1.0);
+		return (pathVariance / n) / (variance(beta) / samples);
+	}
+
+	Size paths;
+	Real pathSum, pathSquares;
+	Size samples;
+	Real sumY, sumC, sumYY, sumCC, sumYC;
+};
+
+#endif // !variance_reduction_hpp
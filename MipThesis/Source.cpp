@@ -1,8 +1,15 @@
 #include <boost/timer.hpp>
+#include <fstream>
 #include <iostream>
 #include <ql/quantlib.hpp>
 #include <marketdata.hpp>
+#include <marketsnapshot.hpp>
 #include <replicationerror.hpp>
+#include <replicationbacktest.hpp>
+#include <replicationreplay.hpp>
+#include <sensitivities.hpp>
+#include <csvrecords.hpp>
+#include <allocationcounter.hpp>
 
 #ifdef BOOST_MSVC
 #  include <ql/auto_link.hpp>
@@ -12,7 +19,7 @@ using namespace QuantLib;
 
 
 // Compute Replication Error as in the Derman and Kamal's research note
-int main(int, char*[]) {
+int main(int argc, char* argv[]) {
 
 	try {
 
@@ -31,43 +38,151 @@ int main(int, char*[]) {
 		Settings::instance().evaluationDate() = todaysDate;
 		todaysDate = Settings::instance().evaluationDate();
 
+		//the built-in quotes, written as a market data file to start from
+		if (argc > 2 && std::string(argv[1]) == "--export-market") {
+			std::ofstream out(argv[2]);
+			QL_REQUIRE(out, "cannot write the market data file " << argv[2]);
+			writeMarketQuotes(out, MarketData::defaultquotes());
+			return 0;
+		}
+
+		//a text file of prices, converted to the binary series the replay maps
+		if (argc > 4 && std::string(argv[1]) == "--import-ticks") {
+			Size ticks = PriceHistory::importPrices(argv[2], argv[3], parseReal(argv[4], "ticks per year"));
+			std::cout << ticks << " prices written to " << argv[3] << std::endl;
+			return 0;
+		}
+
 		//option input-data		
 		Date optionExpiryDate(03, June, 2020);
 		Time maturity = dayCount.yearFraction(settlementDate, optionExpiryDate);
 		Real strike = 18.81;
 		boost::shared_ptr<Quote> underlying(new SimpleQuote(15.35));
 
-		//discounting curve and volatility term structure
-		auto OISTermStructure = MarketData::builddiscountingcurve(settlementDate, fixingDays);
-		auto varTS = MarketData::buildblackvariancesurface(settlementDate, calendar);
+		//the study repeated from each valuation date of a market data file,
+		//the dates spread across the cores and the results written to a file
+		if (argc > 3 && std::string(argv[1]) == "--backtest") {
+			ReplicationBacktest backtest(loadMarketQuotes(argv[2]), Option::Call,
+				optionExpiryDate, strike, fixingDays, calendar);
+			ReplicationSettings settings;
+			settings.nThreads = 0;
+			settings.seed = 42;
+			settings.batchSize = 512;
+			settings.pathKernel = true;
+			Size hedges[] = { 3, 38, 166, 827 };
+			backtest.run(std::vector<Size>(hedges, hedges + LENGTH(hedges)), 10000, argv[3], settings);
+			return 0;
+		}
+
+		//discounting curve and volatility term structure, from the snapshot
+		//saved by a previous run while the market quotes are unchanged; the
+		//adjoint sensitivities move the quotes, so they bootstrap live curves
+		bool sensitivities = argc > 1 && std::string(argv[1]) == "--sensitivities";
+		std::vector<boost::shared_ptr<SimpleQuote> > OISQuotes;
+		boost::shared_ptr<YieldTermStructure> OISTermStructure;
+		boost::shared_ptr<FlatBlackVarianceSurface> varTS;
+		if (sensitivities) {
+			OISTermStructure = MarketData::builddiscountingcurve(settlementDate, fixingDays, &OISQuotes);
+			varTS = MarketData::buildblackvariancesurface(settlementDate, calendar);
+		} else {
+			MarketSnapshot snapshot = MarketSnapshot::cached("marketdata.snapshot",
+				settlementDate, fixingDays, calendar);
+			OISTermStructure = snapshot.discountingCurve();
+			varTS = snapshot.blackVarianceSurface();
+		}
 		Volatility sigma = varTS->blackVol(optionExpiryDate, strike);
+
+		//the hedge replayed on a historical series instead of simulated paths:
+		//one-year options of the same moneyness, a window starting every day,
+		//hedged quarterly, monthly, every 7 days and daily (252 days a year);
+		//the strides not dividing the year of the series are left out
+		if (argc > 2 && std::string(argv[1]) == "--replay") {
+			PriceHistory history(argv[2]);
+			Size yearTicks = std::max<Size>(1, Size(history.ticksPerYear() + 0.5));
+			Size dayTicks = std::max<Size>(1, yearTicks / 252);
+			ReplicationReplay replay(history, Option::Call, strike / underlying->value(),
+				yearTicks, OISTermStructure, sigma);
+			ReplicationSettings settings;
+			settings.nThreads = 0;
+			Size days[] = { 63, 21, 7, 1 };
+			std::vector<Size> strides;
+			for (Size i = 0; i < LENGTH(days); i++)
+				if (yearTicks % (days[i] * dayTicks) == 0)
+					strides.push_back(days[i] * dayTicks);
+			if (strides.empty() || strides.back() != 1)
+				strides.push_back(1);
+			replay.compute(strides, dayTicks, settings, argc > 3 ? argv[3] : "");
+			return 0;
+		}
 				
 		//declaration of the ReplicatonError class
 		ReplicationError rp(Option::Call, maturity, strike, underlying, sigma, OISTermStructure);
 
 		//initialization of the ReplicationError.compute() method
 		Size scenarios = 50000;
-		Size hedgesNum;
+		std::vector<Size> hedgesNums;
+
+		//the scenarios are shared by all the cores, with a fixed master seed
+		ReplicationSettings settings;
+		settings.nThreads = 0;
+		settings.seed = 42;
+		//paths hedged together by the vectorised pricer
+		settings.batchSize = 512;
+		settings.pathKernel = true;
+		//scrambled Sobol draws instead, with the RQMC error of the P&L means
+		//settings.quasiRandom = true;
+		//settings.scrambles = 10;
 	
-		//hedging once a year
-		hedgesNum = 3;
-		rp.compute(hedgesNum, scenarios);
+		//the sample loops of every path configuration checked for heap
+		//allocations, in the Debug builds which count them
+		if (argc > 1 && std::string(argv[1]) == "--check-allocations") {
+			std::vector<Size> hedges = { 3, 38 };
+			ReplicationSettings checkSettings;
+			checkSettings.nThreads = 0;
+			checkSettings.seed = 42;
+			bool passed = checkAllocations("scalar pricer", [&]() {
+				rp.distributions(hedges, 2048, checkSettings);
+			});
+			checkSettings.batchSize = 256;
+			passed &= checkAllocations("batched pricer, path generator", [&]() {
+				rp.distributions(hedges, 2048, checkSettings);
+			});
+			checkSettings.pathKernel = true;
+			passed &= checkAllocations("batched pricer, path kernel", [&]() {
+				rp.distributions(hedges, 2048, checkSettings);
+			});
+			checkSettings.quasiRandom = true;
+			checkSettings.scrambles = 4;
+			passed &= checkAllocations("batched pricer, scrambled Sobol", [&]() {
+				rp.distributions(hedges, 2048, checkSettings);
+			});
+			QL_ENSURE(passed, "heap allocations in the sample loops");
+			return 0;
+		}
+
+		//adjoint sensitivities of the daily hedging P&L to the OIS quotes
+		//and to the volatility surface nodes
+		if (sensitivities) {
+			rp.computeSensitivities(827, 10000, OISQuotes, *varTS, settings);
+			return 0;
+		}
 
+		//hedging once a year
+		hedgesNums.push_back(3);
 		//hedging ones a month
-		hedgesNum = 38;
-		rp.compute(hedgesNum, scenarios);
-
+		hedgesNums.push_back(38);
 		//hedging ones a week
-		hedgesNum = 166;
-		rp.compute(hedgesNum, scenarios);
-
+		hedgesNums.push_back(166);
 		//hedging ones a day
-		hedgesNum = 827;
-		rp.compute(hedgesNum, scenarios);
-
+		hedgesNums.push_back(827);
 		//hedging twice a day
-		hedgesNum = 1654;
-		rp.compute(hedgesNum, scenarios);
+		hedgesNums.push_back(1654);
+
+		//every path is simulated once and hedged at all the frequencies
+		rp.sweep(hedgesNums, scenarios, settings);
+
+		//daily hedging, in batches of 5000 paths until the P&L mean is known within 0.01
+		//rp.computeToTolerance(0.01, 200000, 5000, 827, settings);
 
 
 		double seconds = timer.elapsed();
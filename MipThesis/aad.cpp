@@ -0,0 +1,21 @@
+#include <ql/quantlib.hpp>
+#include <aad.hpp>
+
+using namespace QuantLib;
+
+Tape*& Tape::active() {
+	static thread_local Tape* tape = 0;
+	return tape;
+}
+
+void Tape::propagate(Size end) {
+	for (Size i = nodes_.size(); i-- > end;) {
+		Real adjoint = adjoints_[i];
+		if (adjoint == 0.0)
+			continue;
+		const Node& node = nodes_[i];
+		for (Size k = 0; k < 2; k++)
+			if (node.arguments[k] != none)
+				adjoints_[node.arguments[k]] += adjoint * node.derivatives[k];
+	}
+}
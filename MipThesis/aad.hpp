@@ -0,0 +1,166 @@
+#pragma once
+
+#ifndef aad_hpp
+#define aad_hpp
+
+#include <ql/quantlib.hpp>
+#include <blackdelta.hpp>
+#include <cmath>
+
+using namespace QuantLib;
+
+/* Tape-based reverse mode (adjoint) algorithmic differentiation.
+
+Every operation on a Number with a derivative to track records a node on
+the tape active in the calling thread: the indices of its (at most two)
+arguments and its partial derivatives with respect to them. Sweeping the
+tape backwards from a result gives its derivatives with respect to every
+input in a single pass, whatever the number of inputs.
+
+The simulators keep the tape memory bounded by checkpointing each path:
+the inputs, and whatever is computed from them once for all the paths,
+are recorded before the tape's mark; each path is recorded after it,
+swept back to the mark, which adds its adjoints to the nodes before the
+mark, and then dropped by rewinding the tape. The part before the mark is
+swept once at the end.
+*/
+
+class Tape {
+	public:
+		// index of no node: the argument is a constant
+		static const Size none = Size(-1);
+
+		// a new input
+		Size variable() { return record(0.0, none, 0.0, none); }
+		Size record(Real d0, Size a0, Real d1 = 0.0, Size a1 = none) {
+			Node node = { { d0, d1 }, { a0, a1 } };
+			nodes_.push_back(node);
+			adjoints_.push_back(0.0);
+			return nodes_.size() - 1;
+		}
+		Size size() const { return nodes_.size(); }
+		Real& adjoint(Size i) { return adjoints_[i]; }
+
+		// drops all the nodes, keeping the memory
+		void clear() {
+			nodes_.clear();
+			adjoints_.clear();
+			mark_ = 0;
+		}
+		// the nodes recorded so far are kept by rewindToMark()
+		void mark() { mark_ = nodes_.size(); }
+		void rewindToMark() {
+			nodes_.resize(mark_);
+			adjoints_.resize(mark_);
+		}
+		// sweeps the nodes recorded after the mark, adding their adjoints
+		// to the nodes before it
+		void propagateToMark() { propagate(mark_); }
+		// sweeps the whole tape
+		void propagateToStart() { propagate(0); }
+
+		// the tape the Numbers of the calling thread are recorded on
+		static Tape*& active();
+
+	private:
+		struct Node {
+			Real derivatives[2];
+			Size arguments[2];
+		};
+		void propagate(Size end);
+
+		std::vector<Node> nodes_;
+		std::vector<Real> adjoints_;
+		Size mark_ = 0;
+};
+
+// makes a tape the active one of the calling thread for a scope
+class ActiveTape {
+	public:
+		explicit ActiveTape(Tape& tape) : previous_(Tape::active()) { Tape::active() = &tape; }
+		~ActiveTape() { Tape::active() = previous_; }
+	private:
+		Tape* previous_;
+};
+
+// a real number whose derivatives are recorded on the active tape;
+// constants, built from a Real, are not recorded
+class Number {
+	public:
+		Number(Real value = 0.0) : value_(value), index_(Tape::none) {}
+
+		// a new input of the active tape
+		static Number variable(Real value) {
+			return Number(value, Tape::active()->variable());
+		}
+
+		Real value() const { return value_; }
+		Size index() const { return index_; }
+
+		// result of an operation with the given partial derivatives
+		static Number unary(Real value, const Number& x, Real dx) {
+			if (x.index_ == Tape::none)
+				return Number(value);
+			return Number(value, Tape::active()->record(dx, x.index_));
+		}
+		static Number binary(Real value, const Number& x, Real dx, const Number& y, Real dy) {
+			if (x.index_ == Tape::none)
+				return unary(value, y, dy);
+			if (y.index_ == Tape::none)
+				return unary(value, x, dx);
+			return Number(value, Tape::active()->record(dx, x.index_, dy, y.index_));
+		}
+
+		Number& operator+=(const Number& y) { return *this = *this + y; }
+		Number& operator-=(const Number& y) { return *this = *this - y; }
+		Number& operator*=(const Number& y) { return *this = *this * y; }
+		Number& operator/=(const Number& y) { return *this = *this / y; }
+
+		friend Number operator+(const Number& x, const Number& y) {
+			return binary(x.value_ + y.value_, x, 1.0, y, 1.0);
+		}
+		friend Number operator-(const Number& x, const Number& y) {
+			return binary(x.value_ - y.value_, x, 1.0, y, -1.0);
+		}
+		friend Number operator*(const Number& x, const Number& y) {
+			return binary(x.value_ * y.value_, x, y.value_, y, x.value_);
+		}
+		friend Number operator/(const Number& x, const Number& y) {
+			Real inverse = 1.0 / y.value_;
+			return binary(x.value_ * inverse, x, inverse, y, -x.value_ * inverse * inverse);
+		}
+		friend Number operator-(const Number& x) {
+			return unary(-x.value_, x, -1.0);
+		}
+
+	private:
+		Number(Real value, Size index) : value_(value), index_(index) {}
+		Real value_;
+		Size index_;
+};
+
+inline Number exp(const Number& x) {
+	Real value = std::exp(x.value());
+	return Number::unary(value, x, value);
+}
+
+inline Number log(const Number& x) {
+	return Number::unary(std::log(x.value()), x, 1.0 / x.value());
+}
+
+inline Number sqrt(const Number& x) {
+	Real value = std::sqrt(x.value());
+	return Number::unary(value, x, 0.5 / value);
+}
+
+// the derivative at the kink is taken from the right
+inline Number max(const Number& x, Real floor) {
+	return x.value() >= floor ? x : Number(floor);
+}
+
+inline Number normalCdf(const Number& x) {
+	Real density = M_1_SQRTPI * M_SQRT1_2 * std::exp(-0.5 * x.value() * x.value());
+	return Number::unary(normalCdf(x.value()), x, density);
+}
+
+#endif // !aad_hpp
@@ -0,0 +1,79 @@
+#include <ql/quantlib.hpp>
+#include <allocationcounter.hpp>
+#include <atomic>
+#include <iostream>
+
+using namespace QuantLib;
+
+#ifdef MIP_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+static thread_local Size threadAllocations = 0;
+static std::atomic<Size> sampleLoopAllocations(0);
+
+Size allocationCount() {
+	return threadAllocations;
+}
+
+bool countingAllocations() {
+	return true;
+}
+
+void countLoopAllocations(Size allocations) {
+	if (allocations > 0)
+		sampleLoopAllocations += allocations;
+}
+
+Size loopAllocations() {
+	return sampleLoopAllocations;
+}
+
+void resetLoopAllocations() {
+	sampleLoopAllocations = 0;
+}
+
+// the replacement operators; the array and sized forms forward to these
+void* operator new(std::size_t size) {
+	++threadAllocations;
+	void* p = std::malloc(size > 0 ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+#else
+
+Size allocationCount() {
+	return 0;
+}
+
+bool countingAllocations() {
+	return false;
+}
+
+void countLoopAllocations(Size) {}
+
+Size loopAllocations() {
+	return 0;
+}
+
+void resetLoopAllocations() {}
+
+#endif
+
+bool checkAllocations(const std::string& name, const std::function<void()>& run) {
+	QL_REQUIRE(countingAllocations(),
+		"the allocations are only counted in the Debug builds (MIP_COUNT_ALLOCATIONS)");
+	resetLoopAllocations();
+	run();
+	Size allocations = loopAllocations();
+	std::cout << name << ": " << allocations << " heap allocations in the sample loops, "
+		<< (allocations == 0 ? "passed" : "FAILED") << std::endl;
+	return allocations == 0;
+}
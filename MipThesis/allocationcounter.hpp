@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef allocation_counter_hpp
+#define allocation_counter_hpp
+
+#include <ql/quantlib.hpp>
+#include <functional>
+#include <string>
+
+using namespace QuantLib;
+
+/* Count of the heap allocations of the calling thread.
+
+The Debug configurations of both projects define MIP_COUNT_ALLOCATIONS:
+the global operator new is then replaced by a counting one, and the
+simulators add the allocations of their steady-state sample loops to a
+tally shared by all the threads, which the --check-allocations mode of
+the drivers reads around each configuration. The tallied loops are the
+batched and scalar ones of ReplicationError and the kernel loops of
+AutocallableSimulation and AutocallablePortfolio; the autocallable loop on
+QuantLib's multi-dimensional generator is not tallied, since its evolve()
+returns a new Array at each step. In the Release configurations nothing
+is counted and the tally costs nothing.
+*/
+
+// heap allocations made so far by the calling thread
+Size allocationCount();
+// whether the allocations are counted, i.e. MIP_COUNT_ALLOCATIONS is defined
+bool countingAllocations();
+
+// the tally of the sample loops: a loop adds the allocations it made
+void countLoopAllocations(Size allocations);
+Size loopAllocations();
+void resetLoopAllocations();
+
+// runs a configuration of a simulator and prints whether its sample loops
+// allocated; true if they did not
+bool checkAllocations(const std::string& name, const std::function<void()>& run);
+
+#endif // !allocation_counter_hpp
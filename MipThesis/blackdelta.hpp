@@ -0,0 +1,77 @@
+#pragma once
+
+#ifndef black_delta_hpp
+#define black_delta_hpp
+
+#include <ql/quantlib.hpp>
+#include <cmath>
+
+using namespace QuantLib;
+
+/* Inline Black-Scholes kernels for the hedging loop.
+
+They give the same figures as BlackCalculator for a plain vanilla payoff,
+without building the calculator and its payoff at every hedge, so the
+path pricer can call them at each step without any allocation.
+*/
+
+// how the hedge ratio is computed at each rebalancing
+enum DeltaMethod {
+	ReferenceDelta,   // QuantLib's BlackCalculator
+	ClosedFormDelta,  // closed form with the exact normal CDF
+	FastDelta         // closed form with a polynomial normal CDF
+};
+
+// cumulative normal distribution, from the complementary error function
+inline Real normalCdf(Real x) {
+	return 0.5 * std::erfc(-x * M_SQRT1_2);
+}
+
+// Abramowitz & Stegun 26.2.17 approximation of the cumulative normal
+// distribution: the absolute error is below 7.5e-8 everywhere
+inline Real fastNormalCdf(Real x) {
+	const Real p = 0.2316419;
+	const Real b1 = 0.319381530, b2 = -0.356563782, b3 = 1.781477937,
+		b4 = -1.821255978, b5 = 1.330274429;
+	Real z = std::fabs(x);
+	Real t = 1.0 / (1.0 + p * z);
+	Real density = M_1_SQRTPI * M_SQRT1_2 * std::exp(-0.5 * z * z);
+	Real tail = density * t * (b1 + t * (b2 + t * (b3 + t * (b4 + t * b5))));
+	return x >= 0.0 ? 1.0 - tail : tail;
+}
+
+// N(d1) of the Black formula; a null standard deviation gives the
+// intrinsic limit, as in BlackCalculator
+inline Real blackNd1(Real forward, Real strike, Real stdDev, bool fast) {
+	if (stdDev <= 0.0)
+		return forward > strike ? 1.0 : 0.0;
+	Real d1 = std::log(forward / strike) / stdDev + 0.5 * stdDev;
+	return fast ? fastNormalCdf(d1) : normalCdf(d1);
+}
+
+// Black-Scholes delta with respect to the spot of a plain vanilla option,
+// given the forward and the dividend discount factor to expiry
+inline Real blackDelta(Option::Type type, Real forward, Real strike,
+	Real stdDev, DiscountFactor qDiscount, bool fast) {
+	Real nd1 = blackNd1(forward, strike, stdDev, fast);
+	return qDiscount * (type == Option::Call ? nd1 : nd1 - 1.0);
+}
+
+// Black-Scholes value of a plain vanilla option
+inline Real blackValue(Option::Type type, Real forward, Real strike,
+	Real stdDev, DiscountFactor rDiscount, bool fast) {
+	if (stdDev <= 0.0) {
+		Real intrinsic = type == Option::Call ? forward - strike : strike - forward;
+		return rDiscount * std::max<Real>(intrinsic, 0.0);
+	}
+	Real d1 = std::log(forward / strike) / stdDev + 0.5 * stdDev;
+	Real d2 = d1 - stdDev;
+	Real nd1 = fast ? fastNormalCdf(d1) : normalCdf(d1);
+	Real nd2 = fast ? fastNormalCdf(d2) : normalCdf(d2);
+	if (type == Option::Call)
+		return rDiscount * (forward * nd1 - strike * nd2);
+	else
+		return rDiscount * (strike * (1.0 - nd2) - forward * (1.0 - nd1));
+}
+
+#endif // !black_delta_hpp
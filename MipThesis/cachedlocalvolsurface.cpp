@@ -0,0 +1,112 @@
+#include <ql/quantlib.hpp>
+#include <cachedlocalvolsurface.hpp>
+
+using namespace QuantLib;
+
+CachedLocalVolSurface::CachedLocalVolSurface(const Handle<BlackVolTermStructure>& blackTS,
+											 const Handle<YieldTermStructure>& riskFreeTS,
+											 const Handle<YieldTermStructure>& dividendTS,
+											 const Handle<Quote>& underlying,
+											 Time maxTime, Size nTimes,
+											 Real minSpot, Real maxSpot, Size nSpots)
+	: LocalVolTermStructure(blackTS->referenceDate(), blackTS->calendar(),
+		blackTS->businessDayConvention(), blackTS->dayCounter()),
+	maxDate_(blackTS->maxDate()), maxTime_(maxTime), minSpot_(minSpot), maxSpot_(maxSpot),
+	nTimes_(nTimes), nSpots_(nSpots) {
+
+	QL_REQUIRE(maxTime > 0.0, "the time span of the grid must be positive");
+	QL_REQUIRE(nTimes > 0 && nSpots > 0, "the grid must have at least one interval per axis");
+	QL_REQUIRE(minSpot > 0.0 && maxSpot > minSpot, "invalid spot range [" << minSpot << ", " << maxSpot << "]");
+
+	inverseTimeStep_ = nTimes / maxTime;
+	inverseSpotStep_ = nSpots / (maxSpot - minSpot);
+
+	// the finite differences of the implied variance, once per node
+	vols_.resize((nTimes + 1) * (nSpots + 1));
+	fallbacks_ = 0;
+	for (Size i = 0; i <= nTimes; i++) {
+		Time t = i * maxTime / nTimes;
+		for (Size j = 0; j <= nSpots; j++) {
+			Real spot = minSpot + j * (maxSpot - minSpot) / nSpots;
+			// where the implied surface is not arbitrage-free between its
+			// nodes the local variance is negative: the implied volatility
+			// is kept there instead, and the node counted
+			Real variance = localVariance(*blackTS, *riskFreeTS, *dividendTS, underlying->value(), t, spot);
+			if (variance >= 0.0) {
+				vols_[i * (nSpots + 1) + j] = std::sqrt(variance);
+			}
+			else {
+				vols_[i * (nSpots + 1) + j] = blackTS->blackVol(t, spot, true);
+				fallbacks_++;
+			}
+		}
+	}
+}
+
+// Dupire's formula in the log-moneyness y = log(K/F) of the total implied
+// variance w(t, y), as in QuantLib's LocalVolSurface and with its bumps:
+//   sigma^2 = (dw/dt) / (1 - y/w dw/dy + 1/4 (-1/4 - 1/w + y^2/w^2) (dw/dy)^2 + 1/2 d2w/dy2)
+// The variance is returned with its sign, negative when either the time
+// derivative or the denominator is, instead of being rejected.
+Real CachedLocalVolSurface::localVariance(const BlackVolTermStructure& blackTS,
+										  const YieldTermStructure& riskFreeTS,
+										  const YieldTermStructure& dividendTS,
+										  Real s0, Time t, Real strike) {
+
+	DiscountFactor dr = riskFreeTS.discount(t, true);
+	DiscountFactor dq = dividendTS.discount(t, true);
+	Real forward = s0 * dq / dr;
+
+	// the strike derivatives
+	Real y = std::log(strike / forward);
+	Real dy = (std::fabs(y) > 0.001) ? y * 0.0001 : 0.000001;
+	Real strikep = strike * std::exp(dy);
+	Real strikem = strike / std::exp(dy);
+	Real w = blackTS.blackVariance(t, strike, true);
+	Real wp = blackTS.blackVariance(t, strikep, true);
+	Real wm = blackTS.blackVariance(t, strikem, true);
+	Real dwdy = (wp - wm) / (2.0 * dy);
+	Real d2wdy2 = (wp - 2.0 * w + wm) / (dy * dy);
+
+	// the time derivative at a fixed log-moneyness
+	Real dwdt;
+	if (t == 0.0) {
+		Time dt = 0.0001;
+		Real strikept = strike * dr * dividendTS.discount(t + dt, true)
+			/ (riskFreeTS.discount(t + dt, true) * dq);
+		dwdt = (blackTS.blackVariance(t + dt, strikept, true) - w) / dt;
+	}
+	else {
+		Time dt = std::min<Time>(0.0001, t / 2.0);
+		Real strikept = strike * dr * dividendTS.discount(t + dt, true)
+			/ (riskFreeTS.discount(t + dt, true) * dq);
+		Real strikemt = strike * dr * dividendTS.discount(t - dt, true)
+			/ (riskFreeTS.discount(t - dt, true) * dq);
+		dwdt = (blackTS.blackVariance(t + dt, strikept, true)
+			- blackTS.blackVariance(t - dt, strikemt, true)) / (2.0 * dt);
+	}
+	if (dwdt < 0.0)
+		return dwdt;
+
+	if (dwdy == 0.0 && d2wdy2 == 0.0)
+		return dwdt;
+	Real denominator = 1.0 - y / w * dwdy
+		+ 0.25 * (-0.25 - 1.0 / w + y * y / w / w) * dwdy * dwdy
+		+ 0.5 * d2wdy2;
+	if (denominator <= 0.0)
+		return -1.0;
+	return dwdt / denominator;
+}
+
+void CachedLocalVolSurface::localVols(Time t, const Real* spots, Size n, Real* vols) const {
+	Real a;
+	const Real* lower = &vols_[timeRow(t, a) * (nSpots_ + 1)];
+	for (Size p = 0; p < n; p++)
+		vols[p] = interpolate(lower, a, spots[p]);
+}
+
+Volatility CachedLocalVolSurface::localVolImpl(Time t, Real spot) const {
+	Real a;
+	const Real* lower = &vols_[timeRow(t, a) * (nSpots_ + 1)];
+	return interpolate(lower, a, spot);
+}
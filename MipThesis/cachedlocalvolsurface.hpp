@@ -0,0 +1,92 @@
+#pragma once
+
+#ifndef cached_local_vol_surface_hpp
+#define cached_local_vol_surface_hpp
+
+#include <ql/quantlib.hpp>
+
+using namespace QuantLib;
+
+/* The Dupire local volatility of an implied surface, tabulated once on a
+(time, spot) grid.
+
+QuantLib's LocalVolSurface works out the local volatility by finite
+differences of the implied variance at every call, that is several
+surface lookups per step of every path. Here it is asked once per node of
+a grid evenly spaced in time over [0, maxTime] and in spot over
+[minSpot, maxSpot], and the paths read the table: the cell of a (t, S)
+pair follows from its coordinates, and the volatility is interpolated
+bilinearly between the cell's corners. Outside the grid the volatility is
+extended flat.
+
+Where the implied surface is not arbitrage-free between its nodes the
+local variance comes out negative; the implied volatility is tabulated
+there instead, and the number of such nodes is given by fallbacks().
+
+The table is a snapshot of the inputs when the surface is built: it does
+not follow later changes of the curves, the spot or the implied surface.
+*/
+
+class CachedLocalVolSurface : public LocalVolTermStructure {
+	public:
+		CachedLocalVolSurface(const Handle<BlackVolTermStructure>& blackTS,
+			const Handle<YieldTermStructure>& riskFreeTS,
+			const Handle<YieldTermStructure>& dividendTS,
+			const Handle<Quote>& underlying,
+			Time maxTime, Size nTimes,
+			Real minSpot, Real maxSpot, Size nSpots);
+
+		// TermStructure interface
+		Date maxDate() const { return maxDate_; }
+		// VolatilityTermStructure interface
+		Real minStrike() const { return minSpot_; }
+		Real maxStrike() const { return maxSpot_; }
+
+		// the local volatilities at time t of n spots, the time being
+		// located once for all of them
+		void localVols(Time t, const Real* spots, Size n, Real* vols) const;
+
+		// grid nodes with a negative local variance, where the implied
+		// volatility is used
+		Size fallbacks() const { return fallbacks_; }
+		Size nodes() const { return vols_.size(); }
+
+	protected:
+		Volatility localVolImpl(Time t, Real spot) const;
+
+	private:
+		// the Dupire local variance at (t, strike), negative where the
+		// implied surface allows an arbitrage
+		static Real localVariance(const BlackVolTermStructure& blackTS,
+			const YieldTermStructure& riskFreeTS,
+			const YieldTermStructure& dividendTS,
+			Real s0, Time t, Real strike);
+
+		// the row of the nodes at or before t, and the weight of the next one
+		Size timeRow(Time t, Real& weight) const {
+			Real u = std::min(std::max<Real>(t, 0.0), maxTime_) * inverseTimeStep_;
+			Size i = std::min(Size(u), nTimes_ - 1);
+			weight = u - i;
+			return i;
+		}
+		// interpolation between the rows lower and upper = lower + nSpots_+1
+		Real interpolate(const Real* lower, Real a, Real spot) const {
+			Real x = (std::min(std::max(spot, minSpot_), maxSpot_) - minSpot_) * inverseSpotStep_;
+			Size j = std::min(Size(x), nSpots_ - 1);
+			Real b = x - j;
+			const Real* upper = lower + nSpots_ + 1;
+			return (1.0 - a) * ((1.0 - b) * lower[j] + b * lower[j + 1])
+				+ a * ((1.0 - b) * upper[j] + b * upper[j + 1]);
+		}
+
+		Date maxDate_;
+		Time maxTime_;
+		Real minSpot_, maxSpot_;
+		Size nTimes_, nSpots_;
+		Real inverseTimeStep_, inverseSpotStep_;
+		// vols_[i*(nSpots_+1) + j]: time node i, spot node j
+		std::vector<Volatility> vols_;
+		Size fallbacks_;
+};
+
+#endif // !cached_local_vol_surface_hpp
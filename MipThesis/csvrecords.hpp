@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef csv_records_hpp
+#define csv_records_hpp
+
+#include <ql/quantlib.hpp>
+#include <cctype>
+#include <cstdlib>
+#include <istream>
+#include <sstream>
+
+using namespace QuantLib;
+
+/* Helpers of the readers of the comma separated data files: the records
+are read one line at a time, blank lines and lines starting with '#'
+being skipped, and their fields are parsed with an error naming the
+offending text. */
+
+// s without its leading and trailing blanks
+inline std::string trimField(const std::string& s) {
+	std::string::size_type begin = s.find_first_not_of(" \t\r");
+	if (begin == std::string::npos)
+		return std::string();
+	std::string::size_type end = s.find_last_not_of(" \t\r");
+	return s.substr(begin, end - begin + 1);
+}
+
+// the fields of the next record of the stream, the line counter being
+// moved past it; false at the end of the stream
+inline bool readRecord(std::istream& in, std::vector<std::string>& fields, Size& line) {
+	std::string text;
+	while (std::getline(in, text)) {
+		line++;
+		text = trimField(text);
+		if (text.empty() || text[0] == '#')
+			continue;
+		fields.clear();
+		std::istringstream record(text);
+		std::string field;
+		while (std::getline(record, field, ','))
+			fields.push_back(trimField(field));
+		return true;
+	}
+	return false;
+}
+
+inline Real parseReal(const std::string& field, const char* what) {
+	char* end = 0;
+	Real value = std::strtod(field.c_str(), &end);
+	QL_REQUIRE(!field.empty() && end == field.c_str() + field.size(),
+		"invalid " << what << " '" << field << "'");
+	return value;
+}
+
+// a date given as yyyy-mm-dd
+inline Date parseDate(const std::string& field) {
+	try {
+		return DateParser::parseISO(field);
+	}
+	catch (std::exception&) {
+		QL_FAIL("invalid date '" << field << "', yyyy-mm-dd expected");
+	}
+}
+
+// a period given as a number of days, weeks, months or years: 2W, 18M
+inline Period parsePeriod(const std::string& field) {
+	char* end = 0;
+	long length = std::strtol(field.c_str(), &end, 10);
+	QL_REQUIRE(end != field.c_str() && end + 1 == field.c_str() + field.size(),
+		"invalid period '" << field << "'");
+	switch (std::toupper(*end)) {
+	case 'D':
+		return Period(Integer(length), Days);
+	case 'W':
+		return Period(Integer(length), Weeks);
+	case 'M':
+		return Period(Integer(length), Months);
+	case 'Y':
+		return Period(Integer(length), Years);
+	default:
+		QL_FAIL("invalid period '" << field << "'");
+	}
+}
+
+#endif // !csv_records_hpp
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <ql/quantlib.hpp>
+#include <flatvariancesurface.hpp>
+
+using namespace QuantLib;
+
+namespace {
+
+	// the nodes of a locator, checked before its members are set from them
+	const std::vector<Real>& checkedNodes(const std::vector<Real>& nodes) {
+		QL_REQUIRE(nodes.size() > 1, "at least two nodes are needed");
+		return nodes;
+	}
+
+}
+
+FlatBlackVarianceSurface::Locator::Locator(const std::vector<Real>& nodes)
+	: nodes_(checkedNodes(nodes)), front_(nodes.front()), back_(nodes.back()), last_(nodes.size() - 2) {
+
+	Real narrowest = back_ - front_;
+	for (Size i = 1; i < nodes.size(); i++)
+		narrowest = std::min(narrowest, nodes[i] - nodes[i - 1]);
+	QL_REQUIRE(narrowest > 0.0, "the nodes must be sorted and unique");
+
+	// cells no wider than the narrowest interval, within a sane table size
+	Size nCells = std::min<Size>(Size(std::ceil((back_ - front_) / narrowest)), 1 << 16) + 1;
+	inverseWidth_ = (nCells - 1) / (back_ - front_);
+	cells_.resize(nCells);
+	for (Size c = 0, i = 0; c < nCells; c++) {
+		Real x = front_ + c / inverseWidth_;
+		while (i < last_ && x >= nodes[i + 1])
+			i++;
+		cells_[c] = i;
+	}
+}
+
+FlatBlackVarianceSurface::FlatBlackVarianceSurface(const Date& referenceDate,
+												   const Calendar& calendar,
+												   const std::vector<Date>& dates,
+												   const std::vector<Real>& strikes,
+												   const Matrix& blackVolMatrix,
+												   const DayCounter& dayCounter)
+	: BlackVarianceTermStructure(referenceDate, calendar, Following, dayCounter),
+	nStrikes_(strikes.size()), strikes_(strikes) {
+
+	QL_REQUIRE(!dates.empty(), "no expiries given");
+	QL_REQUIRE(dates.size() == blackVolMatrix.columns(),
+		"mismatch between date vector and vol matrix colums");
+	QL_REQUIRE(strikes.size() == blackVolMatrix.rows(),
+		"mismatch between money-strike vector and vol matrix rows");
+	QL_REQUIRE(dates[0] >= referenceDate, "cannot have dates[0] < referenceDate");
+	maxDate_ = dates.back();
+
+	times_.push_back(0.0);
+	for (Size i = 0; i < dates.size(); i++) {
+		times_.push_back(timeFromReference(dates[i]));
+		QL_REQUIRE(times_[i + 1] > times_[i], "dates must be sorted unique!");
+	}
+	for (Size i = 0; i + 1 < times_.size(); i++)
+		inverseTimeSteps_.push_back(1.0 / (times_[i + 1] - times_[i]));
+	for (Size j = 0; j + 1 < strikes_.size(); j++) {
+		QL_REQUIRE(strikes_[j + 1] > strikes_[j], "strikes must be sorted unique!");
+		inverseStrikeSteps_.push_back(1.0 / (strikes_[j + 1] - strikes_[j]));
+	}
+
+	// as in BlackVarianceSurface, the variance cannot decrease in time
+	variances_.assign(times_.size() * nStrikes_, 0.0);
+	for (Size i = 1; i < times_.size(); i++)
+		for (Size j = 0; j < nStrikes_; j++) {
+			Volatility vol = blackVolMatrix[j][i - 1];
+			variances_[i * nStrikes_ + j] = times_[i] * vol * vol;
+			QL_REQUIRE(variances_[i * nStrikes_ + j] >= variances_[(i - 1) * nStrikes_ + j],
+				"variance must be non-decreasing at i:" << i << " j:" << j);
+		}
+
+	timeLocator_ = Locator(times_);
+	strikeLocator_ = Locator(strikes_);
+}
+
+Real FlatBlackVarianceSurface::blackVarianceImpl(Time t, Real strike) const {
+	Size j = strikeLocator_(strike);
+	return variance(t, j, (strike - strikes_[j]) * inverseStrikeSteps_[j]);
+}
+
+void FlatBlackVarianceSurface::blackVariances(const Time* times, const Real* strikes,
+											  Size n, Real* variances) const {
+	for (Size k = 0; k < n; k++)
+		variances[k] = blackVarianceImpl(times[k], strikes[k]);
+}
+
+void FlatBlackVarianceSurface::blackVariances(const Time* times, Size n, Real strike,
+											  Real* variances) const {
+	Size j = strikeLocator_(strike);
+	Real b = (strike - strikes_[j]) * inverseStrikeSteps_[j];
+	for (Size k = 0; k < n; k++)
+		variances[k] = variance(times[k], j, b);
+}
+
+std::vector<Volatility> FlatBlackVarianceSurface::nodeVolatilities() const {
+	Size nExpiries = times_.size() - 1;
+	std::vector<Volatility> vols(nStrikes_ * nExpiries);
+	for (Size i = 1; i < times_.size(); i++)
+		for (Size j = 0; j < nStrikes_; j++)
+			vols[j * nExpiries + i - 1] = std::sqrt(variances_[i * nStrikes_ + j] / times_[i]);
+	return vols;
+}
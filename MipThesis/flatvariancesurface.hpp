@@ -0,0 +1,144 @@
+#pragma once
+
+#ifndef flat_variance_surface_hpp
+#define flat_variance_surface_hpp
+
+#include <ql/quantlib.hpp>
+
+using namespace QuantLib;
+
+/* A Black variance surface on a strike x expiry grid, giving the figures of
+QuantLib's BlackVarianceSurface with its default settings: bilinear
+interpolation of the total variance in (time, strike) from a null variance
+at t = 0, linear extrapolation in the strike, and the variance growing
+proportionally to the time past the last expiry.
+
+The variances are kept in one contiguous row-major array, one row of
+strikes per expiry, with the times and the inverse widths of the grid
+intervals precomputed. The interval of a time or of a strike is found in
+constant time: each axis is covered by a uniform table of cells no wider
+than its narrowest interval, holding the node at the left of each cell,
+and a query moves at most one node away from its cell's. Many (t, K) pairs
+can be read in one call with blackVariances().
+*/
+
+class FlatBlackVarianceSurface : public BlackVarianceTermStructure {
+	public:
+		FlatBlackVarianceSurface(const Date& referenceDate,
+			const Calendar& calendar,
+			const std::vector<Date>& dates,
+			const std::vector<Real>& strikes,
+			const Matrix& blackVolMatrix,
+			const DayCounter& dayCounter);
+
+		// TermStructure interface
+		Date maxDate() const { return maxDate_; }
+		// VolatilityTermStructure interface
+		Real minStrike() const { return strikes_.front(); }
+		Real maxStrike() const { return strikes_.back(); }
+
+		/* Batched queries, with extrapolation: the variances of the pairs
+		(times[k], strikes[k]), or of the given times at a single strike,
+		whose interval is then looked up once, are written to variances. */
+		void blackVariances(const Time* times, const Real* strikes, Size n, Real* variances) const;
+		void blackVariances(const Time* times, Size n, Real strike, Real* variances) const;
+
+		/* The volatilities of the nodes, vols[j*nExpiries + i] for the j-th
+		strike and the i-th expiry as in the matrix of the constructor, and
+		the variance at (t, strike) interpolated from the given ones as
+		above, on any number type: on the Numbers of the adjoint mode the
+		derivatives flow through the interpolation to the nodes. */
+		std::vector<Volatility> nodeVolatilities() const;
+		template <class T>
+		T interpolatedVariance(Time t, Real strike, const T* vols) const;
+
+	protected:
+		Real blackVarianceImpl(Time t, Real strike) const;
+
+	private:
+		// constant-time search of the interval [nodes[i], nodes[i+1]) holding
+		// x, clamped to the first and last intervals as Interpolation::locate()
+		class Locator {
+			public:
+				Locator() {}
+				explicit Locator(const std::vector<Real>& nodes);
+				Size operator()(Real x) const {
+					if (x <= front_)
+						return 0;
+					if (x >= back_)
+						return last_;
+					Size i = cells_[Size((x - front_) * inverseWidth_)];
+					// rounding of the cell may leave the node one off
+					while (i < last_ && x >= nodes_[i + 1])
+						i++;
+					while (i > 0 && x < nodes_[i])
+						i--;
+					return i;
+				}
+			private:
+				std::vector<Real> nodes_;
+				Real front_, back_, inverseWidth_;
+				Size last_;
+				std::vector<Size> cells_;
+		};
+
+		// variance at time index i and strike index j, with the weights of the
+		// next nodes
+		Real interpolate(Size i, Real a, Size j, Real b) const {
+			const Real* lower = &variances_[i * nStrikes_ + j];
+			const Real* upper = lower + nStrikes_;
+			return (1.0 - a) * ((1.0 - b) * lower[0] + b * lower[1])
+				+ a * ((1.0 - b) * upper[0] + b * upper[1]);
+		}
+		// variance at a time within the grid, the strike's interval and
+		// weight being given
+		Real varianceAt(Time t, Size j, Real b) const {
+			Size i = timeLocator_(t);
+			return interpolate(i, (t - times_[i]) * inverseTimeSteps_[i], j, b);
+		}
+		Real variance(Time t, Size j, Real b) const {
+			if (t == 0.0)
+				return 0.0;
+			if (t <= times_.back())
+				return varianceAt(t, j, b);
+			return varianceAt(times_.back(), j, b) * t / times_.back();
+		}
+
+		Date maxDate_;
+		Size nStrikes_;
+		// t = 0 and the expiries; the strikes
+		std::vector<Time> times_;
+		std::vector<Real> strikes_;
+		std::vector<Real> inverseTimeSteps_, inverseStrikeSteps_;
+		// variances_[i*nStrikes_ + j]: time i, strike j; the row of t = 0 is null
+		std::vector<Real> variances_;
+		Locator timeLocator_, strikeLocator_;
+};
+
+template <class T>
+T FlatBlackVarianceSurface::interpolatedVariance(Time t, Real strike, const T* vols) const {
+	if (t == 0.0)
+		return T(0.0);
+	Size nExpiries = times_.size() - 1;
+	Size j = strikeLocator_(strike);
+	Real b = (strike - strikes_[j]) * inverseStrikeSteps_[j];
+	Time gridTime = std::min(t, times_.back());
+	Size i = timeLocator_(gridTime);
+	Real a = (gridTime - times_[i]) * inverseTimeSteps_[i];
+
+	// the variance of a node, null at t = 0
+	auto node = [&](Size ti, Size sj) {
+		if (ti == 0)
+			return T(0.0);
+		const T& vol = vols[sj * nExpiries + ti - 1];
+		return T(times_[ti] * vol * vol);
+	};
+	T lower = (1.0 - b) * node(i, j) + b * node(i, j + 1);
+	T upper = (1.0 - b) * node(i + 1, j) + b * node(i + 1, j + 1);
+	T variance = (1.0 - a) * lower + a * upper;
+	if (t <= times_.back())
+		return variance;
+	return variance * (t / times_.back());
+}
+
+#endif // !flat_variance_surface_hpp
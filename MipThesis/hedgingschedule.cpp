@@ -0,0 +1,54 @@
+#include <ql/quantlib.hpp>
+#include <hedgingschedule.hpp>
+
+using namespace QuantLib;
+
+HedgingSchedule::HedgingSchedule(boost::shared_ptr<YieldTermStructure> OISTermStructure,
+								 Time maturity,
+								 Volatility vol,
+								 Size nTimeSteps) {
+	QL_REQUIRE(nTimeSteps > 0, "the number of steps must be > 0");
+	QL_REQUIRE(maturity > 0.0, "maturity must be positive");
+
+	// discrete hedging interval
+	Time dt = maturity / nTimeSteps;
+
+	hedgeTimes.reserve(nTimeSteps);
+	accrualFactors.reserve(nTimeSteps);
+	rDiscounts.reserve(nTimeSteps);
+	stdDevs.reserve(nTimeSteps);
+
+	DiscountFactor maturityDiscount = OISTermStructure->discount(maturity);
+	DiscountFactor discount = OISTermStructure->discount(0.0);
+
+	for (Size k = 0; k < nTimeSteps; k++) {
+		Time t = k * dt;
+		Time next = (k == nTimeSteps - 1) ? maturity : (k + 1) * dt;
+		DiscountFactor nextDiscount = OISTermStructure->discount(next);
+
+		hedgeTimes.push_back(t);
+		accrualFactors.push_back(discount / nextDiscount);
+		rDiscounts.push_back(maturityDiscount / discount);
+		stdDevs.push_back(std::sqrt(vol*vol*(maturity - t)));
+
+		discount = nextDiscount;
+	}
+}
+
+HedgingSchedule::HedgingSchedule(boost::shared_ptr<YieldTermStructure> OISTermStructure,
+								 Time maturity,
+								 const FlatBlackVarianceSurface& volatility,
+								 Real strike,
+								 Size nTimeSteps)
+: HedgingSchedule(OISTermStructure, maturity, 0.0, nTimeSteps) {
+
+	// total variances at the hedge times, the strike being located once
+	std::vector<Real> variances(nTimeSteps);
+	volatility.blackVariances(&hedgeTimes[0], nTimeSteps, strike, &variances[0]);
+	Real maturityVariance;
+	volatility.blackVariances(&maturity, 1, strike, &maturityVariance);
+
+	// forward variance from the k-th hedge to maturity
+	for (Size k = 0; k < nTimeSteps; k++)
+		stdDevs[k] = std::sqrt(std::max<Real>(maturityVariance - variances[k], 0.0));
+}
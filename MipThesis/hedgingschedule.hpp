@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef hedging_schedule_hpp
+#define hedging_schedule_hpp
+
+#include <ql/quantlib.hpp>
+#include <flatvariancesurface.hpp>
+
+using namespace QuantLib;
+
+/* The deterministic side of a discrete hedging strategy.
+
+The hedges are carried out at fixed times, so the money account accruals,
+the discount factors to maturity and the residual standard deviations are
+the same for every path. They are computed here once per
+(maturity, nTimeSteps), and the hedging loop only reads them.
+*/
+struct HedgingSchedule {
+	// no hedges
+	HedgingSchedule() {}
+	// nTimeSteps hedges evenly spaced over [0, maturity)
+	HedgingSchedule(boost::shared_ptr<YieldTermStructure> OISTermStructure,
+		Time maturity,
+		Volatility vol,
+		Size nTimeSteps);
+
+	// as above, with the residual standard deviations read at the given
+	// strike off the volatility surface, in one batch over the hedge times
+	HedgingSchedule(boost::shared_ptr<YieldTermStructure> OISTermStructure,
+		Time maturity,
+		const FlatBlackVarianceSurface& volatility,
+		Real strike,
+		Size nTimeSteps);
+
+	// number of hedges, the first one being the initial deal
+	Size size() const { return hedgeTimes.size(); }
+
+	// time of the k-th hedge
+	std::vector<Time> hedgeTimes;
+	// growth of the money account from the k-th hedge to the next one
+	// (to maturity for the last hedge)
+	std::vector<Real> accrualFactors;
+	// discount factor from maturity back to the k-th hedge
+	std::vector<DiscountFactor> rDiscounts;
+	// standard deviation of the stock from the k-th hedge to maturity
+	std::vector<Real> stdDevs;
+};
+
+#endif // !hedging_schedule_hpp
@@ -0,0 +1,61 @@
+#include <ql/quantlib.hpp>
+#include <implieddividendcurve.hpp>
+
+using namespace QuantLib;
+
+ImpliedDividendCurve::ImpliedDividendCurve(const std::vector<Date>& dates,
+										   const std::vector<Real>& forwards,
+										   Real spot,
+										   const boost::shared_ptr<YieldTermStructure>& riskFreeCurve)
+	: InterpolatedDiscountCurve<LogLinear>(dates.at(0), riskFreeCurve->dayCounter()),
+	forwards_(forwards), spot_(spot), riskFreeCurve_(riskFreeCurve) {
+
+	QL_REQUIRE(dates.size() > 1, "at least two dates are needed");
+	QL_REQUIRE(forwards_.size() == dates.size(),
+		forwards_.size() << " forwards given for " << dates.size() << " dates");
+	QL_REQUIRE(spot_ > 0.0, "the spot must be positive");
+
+	dates_ = dates;
+	for (Size i = 0; i < dates_.size(); i++)
+		times_.push_back(timeFromReference(dates_[i]));
+	data_ = std::vector<Real>(dates_.size(), 1.0);
+	interpolation_ = interpolator_.interpolate(times_.begin(), times_.end(), data_.begin());
+
+	registerWith(riskFreeCurve_);
+}
+
+Date ImpliedDividendCurve::maxDate() const {
+	return dates_.back();
+}
+
+const std::vector<Real>& ImpliedDividendCurve::data() const {
+	calculate();
+	return data_;
+}
+
+const std::vector<DiscountFactor>& ImpliedDividendCurve::discounts() const {
+	calculate();
+	return data_;
+}
+
+std::vector<std::pair<Date, Real> > ImpliedDividendCurve::nodes() const {
+	calculate();
+	return InterpolatedDiscountCurve<LogLinear>::nodes();
+}
+
+void ImpliedDividendCurve::update() {
+	LazyObject::update();
+	if (moving_)
+		updated_ = false;
+}
+
+DiscountFactor ImpliedDividendCurve::discountImpl(Time t) const {
+	calculate();
+	return InterpolatedDiscountCurve<LogLinear>::discountImpl(t);
+}
+
+void ImpliedDividendCurve::performCalculations() const {
+	for (Size i = 0; i < dates_.size(); i++)
+		data_[i] = forwards_[i] / spot_ * riskFreeCurve_->discount(dates_[i]);
+	interpolation_.update();
+}
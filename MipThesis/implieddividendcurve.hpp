@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef implied_dividend_curve_hpp
+#define implied_dividend_curve_hpp
+
+#include <ql/quantlib.hpp>
+
+using namespace QuantLib;
+
+/* The dividend discount curve implied by the stock forwards: at each date
+	q(t) = F(t)/S0 * D(t),
+D being the risk free discount curve, with log-linear interpolation.
+
+The curve observes the risk free one and recomputes its nodes lazily, at
+the first read after a change, so that a tick of the rate quotes costs
+nothing here until the dividend curve is actually used.
+*/
+
+class ImpliedDividendCurve : public InterpolatedDiscountCurve<LogLinear>,
+							 public LazyObject {
+	public:
+		// the first date is the reference date of the curve
+		ImpliedDividendCurve(const std::vector<Date>& dates,
+			const std::vector<Real>& forwards,
+			Real spot,
+			const boost::shared_ptr<YieldTermStructure>& riskFreeCurve);
+
+		// TermStructure interface
+		Date maxDate() const;
+		// the nodes, recomputed if needed
+		const std::vector<Real>& data() const;
+		const std::vector<DiscountFactor>& discounts() const;
+		std::vector<std::pair<Date, Real> > nodes() const;
+		// Observer interface
+		void update();
+
+	protected:
+		DiscountFactor discountImpl(Time t) const;
+
+	private:
+		void performCalculations() const;
+
+		std::vector<Real> forwards_;
+		Real spot_;
+		boost::shared_ptr<YieldTermStructure> riskFreeCurve_;
+};
+
+#endif // !implied_dividend_curve_hpp
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <ql/quantlib.hpp>
+#include <incrementaldiscountcurve.hpp>
+
+using namespace QuantLib;
+
+IncrementalDiscountCurve::IncrementalDiscountCurve(const Date& referenceDate,
+												   const std::vector<boost::shared_ptr<RateHelper> >& instruments,
+												   const DayCounter& dayCounter,
+												   Real accuracy)
+	: InterpolatedDiscountCurve<LogLinear>(referenceDate, dayCounter),
+	instruments_(instruments), accuracy_(accuracy), firstSolvedPillar_(0) {
+	initialize();
+}
+
+IncrementalDiscountCurve::IncrementalDiscountCurve(Natural settlementDays,
+												   const Calendar& calendar,
+												   const std::vector<boost::shared_ptr<RateHelper> >& instruments,
+												   const DayCounter& dayCounter,
+												   Real accuracy)
+	: InterpolatedDiscountCurve<LogLinear>(settlementDays, calendar, dayCounter),
+	instruments_(instruments), accuracy_(accuracy), firstSolvedPillar_(0) {
+	initialize();
+}
+
+void IncrementalDiscountCurve::initialize() {
+
+	QL_REQUIRE(!instruments_.empty(), "no instruments given");
+	std::sort(instruments_.begin(), instruments_.end(), detail::BootstrapHelperSorter());
+
+	for (Size i = 0; i < instruments_.size(); i++) {
+		// set once: relinking the helpers at each bootstrap, as
+		// PiecewiseYieldCurve does, would notify the curve while it is solved
+		instruments_[i]->setTermStructure(this);
+		registerWith(instruments_[i]);
+	}
+
+	// the nodes start flat
+	setPillars();
+	data_ = std::vector<Real>(dates_.size(), 1.0);
+	interpolation_ = interpolator_.interpolate(times_.begin(), times_.end(), data_.begin());
+}
+
+void IncrementalDiscountCurve::setPillars() const {
+	dates_.assign(1, referenceDate());
+	for (Size i = 0; i < instruments_.size(); i++) {
+		Date pillar = instruments_[i]->latestDate();
+		QL_REQUIRE(pillar > dates_.back(), "instrument " << i + 1 << " has pillar " << pillar
+			<< ", after " << dates_.back() << " expected");
+		dates_.push_back(pillar);
+	}
+	times_.resize(dates_.size());
+	for (Size i = 0; i < dates_.size(); i++)
+		times_[i] = timeFromReference(dates_[i]);
+}
+
+Date IncrementalDiscountCurve::maxDate() const {
+	// the pillars follow the evaluation date
+	calculate();
+	return dates_.back();
+}
+
+const std::vector<Time>& IncrementalDiscountCurve::times() const {
+	calculate();
+	return times_;
+}
+
+const std::vector<Date>& IncrementalDiscountCurve::dates() const {
+	calculate();
+	return dates_;
+}
+
+const std::vector<Real>& IncrementalDiscountCurve::data() const {
+	calculate();
+	return data_;
+}
+
+const std::vector<DiscountFactor>& IncrementalDiscountCurve::discounts() const {
+	calculate();
+	return data_;
+}
+
+std::vector<std::pair<Date, Real> > IncrementalDiscountCurve::nodes() const {
+	calculate();
+	return InterpolatedDiscountCurve<LogLinear>::nodes();
+}
+
+void IncrementalDiscountCurve::update() {
+	// as in PiecewiseYieldCurve: the observers are notified by the lazy
+	// object, once until the next calculation
+	LazyObject::update();
+	if (moving_)
+		updated_ = false;
+}
+
+Size IncrementalDiscountCurve::firstSolvedPillar() const {
+	calculate();
+	return firstSolvedPillar_;
+}
+
+DiscountFactor IncrementalDiscountCurve::discountImpl(Time t) const {
+	calculate();
+	return InterpolatedDiscountCurve<LogLinear>::discountImpl(t);
+}
+
+void IncrementalDiscountCurve::performCalculations() const {
+
+	Size n = instruments_.size();
+	for (Size i = 0; i < n; i++)
+		QL_REQUIRE(instruments_[i]->quote()->isValid(), "instrument " << i + 1 << " has an invalid quote");
+
+	// the pillars are read again from the helpers whenever the curve is
+	// notified: those of a moving curve follow its reference date, and the
+	// helpers of a curve on a fixed date may date theirs again when the
+	// evaluation date changes. If any pillar moved all of them are solved.
+	std::vector<Date> previousDates(dates_);
+	setPillars();
+	bool moved = dates_ != previousDates;
+
+	// the first pillar whose quote moved; when none did, the notification
+	// came from elsewhere (e.g. the evaluation date) and all are solved
+	bool solved = solvedQuotes_.size() == n;
+	Size first = 0;
+	if (solved && !moved) {
+		while (first < n && instruments_[first]->quote()->value() == solvedQuotes_[first])
+			first++;
+		if (first == n)
+			first = 0;
+	}
+
+	for (Size i = first; i < n; i++)
+		solvePillar(i, solved);
+	interpolation_ = interpolator_.interpolate(times_.begin(), times_.end(), data_.begin());
+	interpolation_.update();
+
+	solvedQuotes_.resize(n);
+	for (Size i = 0; i < n; i++)
+		solvedQuotes_[i] = instruments_[i]->quote()->value();
+	firstSolvedPillar_ = first;
+}
+
+void IncrementalDiscountCurve::solvePillar(Size i, bool previousGuess) const {
+
+	// the interpolation up to the pillar: the helper does not read past it
+	Size node = i + 1;
+	interpolation_ = interpolator_.interpolate(times_.begin(), times_.begin() + node + 1, data_.begin());
+
+	const boost::shared_ptr<RateHelper>& helper = instruments_[i];
+	auto quoteError = [&](DiscountFactor discount) {
+		data_[node] = discount;
+		interpolation_.update();
+		return helper->quoteError();
+	};
+
+	Brent solver;
+	solver.setLowerBound(QL_EPSILON);
+	DiscountFactor guess = previousGuess ? data_[node] : data_[node - 1];
+	data_[node] = solver.solve(quoteError, accuracy_, guess, 0.01);
+	interpolation_.update();
+}
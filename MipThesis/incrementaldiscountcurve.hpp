@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef incremental_discount_curve_hpp
+#define incremental_discount_curve_hpp
+
+#include <ql/quantlib.hpp>
+
+using namespace QuantLib;
+
+/* A discount curve bootstrapped on rate helpers, log-linear in the
+discount factors as PiecewiseYieldCurve<Discount, LogLinear>, which
+re-solves only what a quote update can change.
+
+With a local interpolation the node of a pillar only depends on the
+quotes of the pillars up to it: the helpers are sorted by pillar and none
+of them reads the curve past its own pillar. When a quote changes, the
+nodes before its pillar are kept and the bootstrap restarts from it, each
+node using its previous value as a guess. As any lazy object the curve is
+only re-solved when it is next read, so that several quotes updated
+before a read are solved for once, from the first of them on.
+
+The pillars are read again from the helpers at each calculation: a curve
+built on settlement days moves with the evaluation date, and the helpers
+of a curve on a fixed reference date may date their pillars again when the
+evaluation date changes. When any pillar moves, all of them are solved,
+each from its previous node.
+*/
+
+class IncrementalDiscountCurve : public InterpolatedDiscountCurve<LogLinear>,
+								 public LazyObject {
+	public:
+		IncrementalDiscountCurve(const Date& referenceDate,
+			const std::vector<boost::shared_ptr<RateHelper> >& instruments,
+			const DayCounter& dayCounter,
+			Real accuracy = 1.0e-12);
+		IncrementalDiscountCurve(Natural settlementDays,
+			const Calendar& calendar,
+			const std::vector<boost::shared_ptr<RateHelper> >& instruments,
+			const DayCounter& dayCounter,
+			Real accuracy = 1.0e-12);
+
+		// TermStructure interface
+		Date maxDate() const;
+		// the nodes, solved if needed
+		const std::vector<Time>& times() const;
+		const std::vector<Date>& dates() const;
+		const std::vector<Real>& data() const;
+		const std::vector<DiscountFactor>& discounts() const;
+		std::vector<std::pair<Date, Real> > nodes() const;
+		// Observer interface
+		void update();
+
+		// index of the first pillar re-solved by the last bootstrap
+		Size firstSolvedPillar() const;
+
+	protected:
+		DiscountFactor discountImpl(Time t) const;
+
+	private:
+		// sorts the instruments and dates the nodes on their pillars
+		void initialize();
+		// the reference date and the pillars, from the instruments
+		void setPillars() const;
+		void performCalculations() const;
+		// solves the node of the i-th pillar on the nodes before it
+		void solvePillar(Size i, bool previousGuess) const;
+
+		std::vector<boost::shared_ptr<RateHelper> > instruments_;
+		Real accuracy_;
+		// the quotes the nodes are solved for
+		mutable std::vector<Real> solvedQuotes_;
+		mutable Size firstSolvedPillar_;
+};
+
+#endif // !incremental_discount_curve_hpp
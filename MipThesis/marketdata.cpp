@@ -1,182 +1,56 @@
 #include <ql/quantlib.hpp>
 #include <marketdata.hpp>
+#include <incrementaldiscountcurve.hpp>
+#include <implieddividendcurve.hpp>
 
 using namespace QuantLib;
 
-boost::shared_ptr<YieldTermStructure> MarketData::builddiscountingcurve(Date settlementDate, Natural fixingDays) {
-
-	// eonia swap
-	Rate s1wQuote = -0.0036;
-	Rate s2wQuote = -0.0036;
-	Rate s1mQuote = -0.00359;
-	Rate s2mQuote = -0.00359;
-	Rate s3mQuote = -0.00359;
-	Rate s4mQuote = -0.00358;
-	Rate s5mQuote = -0.00346;
-	Rate s6mQuote = -0.00355;
-	Rate s7mQuote = -0.00353;
-	Rate s8mQuote = -0.00348;
-	Rate s9mQuote = -0.00344;
-	Rate s10mQuote = -0.00341;
-	Rate s11mQuote = -0.00336;
-	Rate s1yQuote = -0.00331;
-	Rate s1_5yQuote = -0.00297;
-	Rate s2yQuote = -0.00253;
-	Rate s2_5yQuote = -0.00211;
-	Rate s3yQuote = -0.00145;
-	Rate s3_5yQuote = -0.00037;
-	Rate s5yQuote = -0.00082;
-	Rate s6yQuote = -0.00216;
+boost::shared_ptr<YieldTermStructure> MarketData::builddiscountingcurve(Date settlementDate, Natural fixingDays,
+	std::vector<boost::shared_ptr<SimpleQuote> >* quotes) {
+	return builddiscountingcurve(defaultquotes(), settlementDate, fixingDays, quotes);
+}
 
-	/********************
-	***    QUOTES    ***
-	********************/
 
-	// SimpleQuote stores a value which can be manually changed;
-	// other Quote subclasses could read the value from a database
-	// or some kind of data feed.
+namespace {
 
+	// one OISRateHelper per eonia swap of the market, on the quotes given back in rates
+	std::vector<boost::shared_ptr<RateHelper> > OISHelpers(const MarketQuotes& market, Natural fixingDays,
+		std::vector<boost::shared_ptr<SimpleQuote> >& rates) {
 
-	// eonia swaps
-	boost::shared_ptr<Quote> s1wRate(new SimpleQuote(s1wQuote));
-	boost::shared_ptr<Quote> s2wRate(new SimpleQuote(s2wQuote));
-	boost::shared_ptr<Quote> s1mRate(new SimpleQuote(s1mQuote));
-	boost::shared_ptr<Quote> s2mRate(new SimpleQuote(s2mQuote));
-	boost::shared_ptr<Quote> s3mRate(new SimpleQuote(s3mQuote));
-	boost::shared_ptr<Quote> s4mRate(new SimpleQuote(s4mQuote));
-	boost::shared_ptr<Quote> s5mRate(new SimpleQuote(s5mQuote));
-	boost::shared_ptr<Quote> s6mRate(new SimpleQuote(s6mQuote));
-	boost::shared_ptr<Quote> s7mRate(new SimpleQuote(s7mQuote));
-	boost::shared_ptr<Quote> s8mRate(new SimpleQuote(s8mQuote));
-	boost::shared_ptr<Quote> s9mRate(new SimpleQuote(s9mQuote));
-	boost::shared_ptr<Quote> s10mRate(new SimpleQuote(s10mQuote));
-	boost::shared_ptr<Quote> s11mRate(new SimpleQuote(s11mQuote));
-	boost::shared_ptr<Quote> s1yRate(new SimpleQuote(s1yQuote));
-	boost::shared_ptr<Quote> s1_5yRate(new SimpleQuote(s1_5yQuote));
-	boost::shared_ptr<Quote> s2yRate(new SimpleQuote(s2yQuote));
-	boost::shared_ptr<Quote> s2_5yRate(new SimpleQuote(s2_5yQuote));
-	boost::shared_ptr<Quote> s3yRate(new SimpleQuote(s3yQuote));
-	boost::shared_ptr<Quote> s3_5yRate(new SimpleQuote(s3_5yQuote));
-	boost::shared_ptr<Quote> s5yRate(new SimpleQuote(s5yQuote));
-	boost::shared_ptr<Quote> s6yRate(new SimpleQuote(s6yQuote));
+		// RateHelpers are built from the quotes together with other
+		// instrument dependant infos.  Quotes are passed in relinkable
+		// handles which could be relinked to some other data source later.
+
+		boost::shared_ptr<OvernightIndex> OvernightIndex(new Eonia);
+
+		Size nSwaps = market.OISTenors.size();
+		std::vector<boost::shared_ptr<RateHelper> > OISInstruments;
+		rates.clear();
+		rates.reserve(nSwaps);
+		OISInstruments.reserve(nSwaps);
+		for (Size i = 0; i < nSwaps; i++) {
+			rates.push_back(boost::shared_ptr<SimpleQuote>(new SimpleQuote(market.OISRates[i])));
+			OISInstruments.push_back(boost::shared_ptr<RateHelper>(new OISRateHelper(
+				fixingDays,
+				market.OISTenors[i],
+				Handle<Quote>(rates.back()),
+				OvernightIndex)));
+		}
+		return OISInstruments;
+	}
+
+}
+
+
+boost::shared_ptr<YieldTermStructure> MarketData::builddiscountingcurve(const MarketQuotes& market,
+	Date settlementDate, Natural fixingDays, std::vector<boost::shared_ptr<SimpleQuote> >* quotes) {
 
 	/*********************
 	***  RATE HELPERS ***
 	*********************/
 
-	// RateHelpers are built from the above quotes together with
-	// other instrument dependant infos.  Quotes are passed in
-	// relinkable handles which could be relinked to some other
-	// data source later.
-
-	//OISRateHelpers
-	boost::shared_ptr<OvernightIndex> OvernightIndex(new Eonia);
-
-	boost::shared_ptr<RateHelper>s1w(new OISRateHelper(
-		fixingDays,
-		1 * Weeks,
-		Handle<Quote>(s1wRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s2w(new OISRateHelper(
-		fixingDays,
-		2 * Weeks,
-		Handle<Quote>(s2wRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s1m(new OISRateHelper(
-		fixingDays,
-		1 * Months,
-		Handle<Quote>(s1mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s2m(new OISRateHelper(
-		fixingDays,
-		2 * Months,
-		Handle<Quote>(s2mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s3m(new OISRateHelper(
-		fixingDays,
-		3 * Months,
-		Handle<Quote>(s3mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s4m(new OISRateHelper(
-		fixingDays,
-		4 * Months,
-		Handle<Quote>(s4mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s5m(new OISRateHelper(
-		fixingDays,
-		5 * Months,
-		Handle<Quote>(s5mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s6m(new OISRateHelper(
-		fixingDays,
-		6 * Months,
-		Handle<Quote>(s6mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s7m(new OISRateHelper(
-		fixingDays,
-		7 * Months,
-		Handle<Quote>(s7mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s8m(new OISRateHelper(
-		fixingDays,
-		8 * Months,
-		Handle<Quote>(s8mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s9m(new OISRateHelper(
-		fixingDays,
-		9 * Months,
-		Handle<Quote>(s9mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s10m(new OISRateHelper(
-		fixingDays,
-		10 * Months,
-		Handle<Quote>(s10mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s11m(new OISRateHelper(
-		fixingDays,
-		11 * Months,
-		Handle<Quote>(s11mRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s1y(new OISRateHelper(
-		fixingDays,
-		1 * Years,
-		Handle<Quote>(s1yRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s1_5y(new OISRateHelper(
-		fixingDays,
-		18 * Months,
-		Handle<Quote>(s1_5yRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s2y(new OISRateHelper(
-		fixingDays,
-		2 * Years,
-		Handle<Quote>(s2yRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s2_5y(new OISRateHelper(
-		fixingDays,
-		30 * Months,
-		Handle<Quote>(s2_5yRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s3y(new OISRateHelper(
-		fixingDays,
-		3 * Years,
-		Handle<Quote>(s3yRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s3_5y(new OISRateHelper(
-		fixingDays,
-		42 * Months,
-		Handle<Quote>(s3_5yRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s5y(new OISRateHelper(
-		fixingDays,
-		5 * Years,
-		Handle<Quote>(s5yRate),
-		OvernightIndex));
-	boost::shared_ptr<RateHelper>s6y(new OISRateHelper(
-		fixingDays,
-		6 * Years,
-		Handle<Quote>(s6yRate),
-		OvernightIndex));
+	std::vector<boost::shared_ptr<SimpleQuote> > rates;
+	std::vector<boost::shared_ptr<RateHelper> > OISInstruments = OISHelpers(market, fixingDays, rates);
 
 	/*********************
 	**  CURVE BUILDING **
@@ -187,45 +61,79 @@ boost::shared_ptr<YieldTermStructure> MarketData::builddiscountingcurve(Date set
 	DayCounter termStructureDayCounter =
 		ActualActual(ActualActual::ISDA);
 
-	// The OIS-discounting curve
-	std::vector<boost::shared_ptr<RateHelper> > OISInstruments;
-	OISInstruments.push_back(s1w);
-	OISInstruments.push_back(s2w);
-	OISInstruments.push_back(s1m);
-	OISInstruments.push_back(s2m);
-	OISInstruments.push_back(s3m);
-	OISInstruments.push_back(s4m);
-	OISInstruments.push_back(s5m);
-	OISInstruments.push_back(s6m);
-	OISInstruments.push_back(s7m);
-	OISInstruments.push_back(s8m);
-	OISInstruments.push_back(s9m);
-	OISInstruments.push_back(s10m);
-	OISInstruments.push_back(s11m);
-	OISInstruments.push_back(s1y);
-	OISInstruments.push_back(s1_5y);
-	OISInstruments.push_back(s2y);
-	OISInstruments.push_back(s2_5y);
-	OISInstruments.push_back(s3y);
-	OISInstruments.push_back(s3_5y);
-	OISInstruments.push_back(s5y);
-	OISInstruments.push_back(s6y);
-
+	// bootstrapped as PiecewiseYieldCurve<Discount, LogLinear>, but a quote
+	// update only re-solves the pillars from the updated one on
 	boost::shared_ptr<YieldTermStructure> OISTermStructure(
-		new PiecewiseYieldCurve<Discount, LogLinear>(
+		new IncrementalDiscountCurve(
 			settlementDate, OISInstruments,
 			termStructureDayCounter));
 
+	// the quotes, in pillar order, for whoever needs to move them
+	if (quotes)
+		*quotes = rates;
+
+	return OISTermStructure;
+}
+
+
+boost::shared_ptr<YieldTermStructure> MarketData::buildmovingdiscountingcurve(const MarketQuotes& market,
+	Natural fixingDays, Calendar calendar, std::vector<boost::shared_ptr<SimpleQuote> >* quotes) {
+
+	std::vector<boost::shared_ptr<SimpleQuote> > rates;
+	std::vector<boost::shared_ptr<RateHelper> > OISInstruments = OISHelpers(market, fixingDays, rates);
+
+	// the OIS helpers are dated again at each evaluation date, and so is the curve
+	boost::shared_ptr<YieldTermStructure> OISTermStructure(
+		new IncrementalDiscountCurve(
+			fixingDays, calendar, OISInstruments,
+			ActualActual(ActualActual::ISDA)));
+
+	if (quotes)
+		*quotes = rates;
+
 	return OISTermStructure;
 }
 
 
-boost::shared_ptr<BlackVarianceSurface> MarketData::buildblackvariancesurface(Date settlementDate, Calendar calendar) {
+boost::shared_ptr<FlatBlackVarianceSurface> MarketData::buildblackvariancesurface(Date settlementDate, Calendar calendar) {
+	return buildblackvariancesurface(defaultquotes(), settlementDate, calendar);
+}
+
+
+boost::shared_ptr<FlatBlackVarianceSurface> MarketData::buildblackvariancesurface(Date settlementDate, Calendar calendar,
+	const Matrix& blackVolMatrix) {
+	MarketQuotes market = defaultquotes();
+	market.vols = blackVolMatrix;
+	return buildblackvariancesurface(market, settlementDate, calendar);
+}
+
+
+boost::shared_ptr<FlatBlackVarianceSurface> MarketData::buildblackvariancesurface(const MarketQuotes& market,
+	Date settlementDate, Calendar calendar) {
 
 	DayCounter dc = Actual365Fixed();
 
+	QL_REQUIRE(market.vols.rows() == market.volStrikes.size() && market.vols.columns() == market.volExpiries.size(),
+		"volatility matrix is " << market.vols.rows() << "x" << market.vols.columns()
+		<< ", " << market.volStrikes.size() << "x" << market.volExpiries.size() << " expected");
+
+	// BlackVarianceSurface's figures, on a flat grid with constant time lookups
+	const boost::shared_ptr<FlatBlackVarianceSurface> varTS(
+		new FlatBlackVarianceSurface(settlementDate, calendar,
+			market.volExpiries, market.volStrikes, market.vols,
+			dc));
+
+	varTS->enableExtrapolation(true);
+			
+	return varTS;
+
+}
+
+
+std::vector<Date> MarketData::blackvolexpiries() {
+
 	//expiry dates
-	Date expiryDates[] = { settlementDate,
+	Date expiryDates[] = {
 		Date(06, April, 2017),
 		Date(07, April, 2017),
 		Date(13, April, 2017),
@@ -256,13 +164,21 @@ boost::shared_ptr<BlackVarianceSurface> MarketData::buildblackvariancesurface(Da
 		Date(31, December, 2021),
 		Date(30, December, 2022) };
 
-	std::vector<Date> dates(expiryDates, expiryDates + LENGTH(expiryDates));
-	
+	return std::vector<Date>(expiryDates, expiryDates + LENGTH(expiryDates));
+}
+
+
+std::vector<Real> MarketData::blackvolstrikes() {
+
 	//strike prices for the vola-surface
 	Real K[] = { 14.00, 14.25, 14.50, 14.75, 15.00, 15.25, 15.50, 15.75, 16.00, 16.25, 16.50, 16.75, 17.00,
 		17.25, 17.50, 17.75, 18.00, 18.50, 19.00, 20.00 };
 
-	std::vector<Real> strikes(K, K + LENGTH(K));
+	return std::vector<Real>(K, K + LENGTH(K));
+}
+
+
+Matrix MarketData::blackvolmatrix() {
 
 	//volatility surface construction
 	Volatility v[] =
@@ -297,26 +213,27 @@ boost::shared_ptr<BlackVarianceSurface> MarketData::buildblackvariancesurface(Da
 		0.25490, 0.25400, 0.25320, 0.25230, 0.25150, 0.25070, 0.24990, 0.24920, 0.24850, 0.24780, 0.24710, 0.24640, 0.24580, 0.24520, 0.24460, 0.24400, 0.24350, 0.24240, 0.24140, 0.23960
 	};
 
-	Matrix blackVolMatrix(strikes.size(), dates.size() - 1);
-	for (Size i = 0; i < strikes.size(); ++i)
-		for (Size j = 1; j < dates.size(); ++j) {
-			blackVolMatrix[i][j - 1] = v[i*(dates.size() - 1) + j - 1];
+	const Size nStrikes = 20, nExpiries = 29;
+	QL_ENSURE(LENGTH(v) == nStrikes * nExpiries, "wrong number of volatility quotes");
+
+	Matrix blackVolMatrix(nStrikes, nExpiries);
+	for (Size i = 0; i < nStrikes; ++i)
+		for (Size j = 0; j < nExpiries; ++j) {
+			blackVolMatrix[i][j] = v[i*nExpiries + j];
 		}
 
-	const boost::shared_ptr<BlackVarianceSurface> varTS(
-		new BlackVarianceSurface(settlementDate, calendar,
-			std::vector<Date>(dates.begin() + 1, dates.end()),
-			strikes, blackVolMatrix,
-			dc));
+	return blackVolMatrix;
+}
 
-	varTS->enableExtrapolation(true);
-			
-	return varTS;
 
+boost::shared_ptr<YieldTermStructure> MarketData::buildbonddiscountingurve(Date settlementDate, Natural fixingDays,
+	std::vector<boost::shared_ptr<SimpleQuote> >* quotes) {
+	return buildbonddiscountingurve(defaultquotes(), settlementDate, fixingDays, quotes);
 }
 
 
-boost::shared_ptr<YieldTermStructure> MarketData::buildbonddiscountingurve(Date settlementDate, Natural fixingDays) {
+boost::shared_ptr<YieldTermStructure> MarketData::buildbonddiscountingurve(const MarketQuotes& market,
+	Date settlementDate, Natural fixingDays, std::vector<boost::shared_ptr<SimpleQuote> >* quotes) {
 
 	Calendar calendar = TARGET();
 
@@ -324,62 +241,30 @@ boost::shared_ptr<YieldTermStructure> MarketData::buildbonddiscountingurve(Date
 
 	// setup bonds
 	Real redemption = 100.0;
-
-	Date issueDates[] = {Date(03 , October , 2012),
-		Date(05 , November , 2012),
-		Date(16 , January , 2013),
-		Date(12 , February , 2003),
-		Date(8 , May , 2008),
-		Date(24 , September , 2013),
-		Date(11 , December , 2013),
-		Date(01 , March , 1999),
-		Date(23 , September , 2009),
-		Date(28 , January , 2010),
-		Date(14 , April , 2010),
-		Date(16 , July , 2012),
-		Date(14 , July , 2016),
-		Date(19 , February , 2010),
-		Date(18 , January , 2017) };
-
-	Date maturityDates[] = {Date(03 , October , 2017),
-		Date(05 , November, 2017),
-		Date(16 , January, 2018),
-		Date(12 , February, 2018),
-		Date(8 , May , 2018),
-		Date(24 , September , 2018),
-		Date(11 , December , 2018),
-		Date(01 , March , 2019),
-		Date(23 , September , 2019),
-		Date(28 , January , 2020),
-		Date(14 , April , 2020),
-		Date(27 , January , 2021),
-		Date(14 , July , 2021),
-		Date(19 , February , 2023),
-		Date(18 , January  , 2024) };
-	
-	Real couponRates[] = { 0.048, 0.04, 0.033, 0.049, 0.06625, 0.0225, 0.02, 0.046, 0.05, 0.0435, 0.04125, 0.05, 0.01015, 0.0463, 0.01375 } ;
-	Real marketQuotes[] = { 102.36,	102.326, 101.154, 103.848, 106.723, 103.598, 102.531, 108.286, 108.708, 109.181, 110.579, 118.708, 100.588,	116.948, 99.127};
-	Real numberOfBonds = LENGTH(couponRates);
-
+	Size numberOfBonds = market.bondPrices.size();
 
 	/********************
 	***    QUOTES    ***
 	********************/
 
 	std::vector< boost::shared_ptr<SimpleQuote> > quote;
+	quote.reserve(numberOfBonds);
 	for (Size i = 0; i<numberOfBonds; i++) {
-		boost::shared_ptr<SimpleQuote> cp(new SimpleQuote(marketQuotes[i]));
+		boost::shared_ptr<SimpleQuote> cp(new SimpleQuote(market.bondPrices[i]));
 		quote.push_back(cp);
 	}
+	if (quotes)
+		*quotes = quote;
 
 	//BondRateHelper
 	DayCounter FixedBondsDayCounter = ActualActual(ActualActual::Bond);
 
-	std::vector<boost::shared_ptr<BondHelper> > bondsHelpers;
+	std::vector<boost::shared_ptr<RateHelper> > bondInstruments;
+	bondInstruments.reserve(numberOfBonds);
 
 	for (Size i = 0; i<numberOfBonds; i++) {
 
-		Schedule schedule(issueDates[i], maturityDates[i], Period(Annual), calendar,
+		Schedule schedule(market.bondIssueDates[i], market.bondMaturityDates[i], Period(Annual), calendar,
 			Unadjusted, Unadjusted, DateGeneration::Backward, false);
 
 		boost::shared_ptr<FixedRateBondHelper> bondHelper(new FixedRateBondHelper(
@@ -387,13 +272,13 @@ boost::shared_ptr<YieldTermStructure> MarketData::buildbonddiscountingurve(Date
 			fixingDays,
 			100.0,
 			schedule,
-			std::vector<Rate>(1, couponRates[i]),
+			std::vector<Rate>(1, market.bondCoupons[i]),
 			ActualActual(ActualActual::Bond),
 			Unadjusted,
 			redemption,
-			issueDates[i]));
+			market.bondIssueDates[i]));
 		
-		bondsHelpers.push_back(bondHelper);
+		bondInstruments.push_back(bondHelper);
 	}
 
 
@@ -408,13 +293,6 @@ boost::shared_ptr<YieldTermStructure> MarketData::buildbonddiscountingurve(Date
 
 	double tolerance = 1.0e-15;
 
-	std::vector<boost::shared_ptr<RateHelper> > bondInstruments;
-
-	// Adding the the Fixed rate bonds to the curve for the long end
-	for (Size i = 0; i<numberOfBonds; i++) {
-		bondInstruments.push_back(bondsHelpers[i]);
-	}
-
 	boost::shared_ptr<YieldTermStructure> bondDiscountingTermStructure(
 		new PiecewiseYieldCurve<Discount, LogLinear>(
 			settlementDate, bondInstruments,
@@ -426,92 +304,98 @@ boost::shared_ptr<YieldTermStructure> MarketData::buildbonddiscountingurve(Date
 
 
 boost::shared_ptr<YieldTermStructure> MarketData::builddividendcurve(Date settlementDate, Natural fixingDays, boost::shared_ptr<YieldTermStructure> OISTermStructure) {
+	return builddividendcurve(defaultquotes(), settlementDate, fixingDays, OISTermStructure);
+}
+
 
-	Real s0 = 15.35;
-
-	//dates
-	Date expiry0(04, April, 2017);
-	Date expiry1(06, April, 2017);
-	Date expiry2(07, April, 2017);
-	Date expiry3(13, April, 2017);
-	Date expiry4(20, April, 2017);
-	Date expiry5(21, April, 2017);
-	Date expiry6(27, April, 2017);
-	Date expiry7(18, May, 2017);
-	Date expiry8(19, May, 2017);
-	Date expiry9(15, June, 2017);
-	Date expiry10(16, June, 2017);
-	Date expiry11(29, June, 2017);
-	Date expiry12(14, September, 2017);
-	Date expiry13(15, September, 2017);
-	Date expiry14(14, December, 2017);
-	Date expiry15(15, December, 2017);
-	Date expiry16(15, March, 2018);
-	Date expiry17(16, March, 2018);
-	Date expiry18(14, June, 2018);
-	Date expiry19(15, June, 2018);
-	Date expiry20(20, December, 2018);
-	Date expiry21(21, December, 2018);
-	Date expiry22(20, June, 2019);
-	Date expiry23(21, June, 2019);
-	Date expiry24(19, December, 2019);
-	Date expiry25(20, December, 2019);
-	Date expiry26(17, December, 2020);
-	Date expiry27(16, December, 2021);
-	Date expiry28(31, December, 2021);
-	Date expiry29(30, December, 2022);
-
-	std::vector<Date> dates;
-	dates.push_back(expiry0);
-	dates.push_back(expiry1);
-	dates.push_back(expiry2);
-	dates.push_back(expiry3);
-	dates.push_back(expiry4);
-	dates.push_back(expiry5);
-	dates.push_back(expiry6);
-	dates.push_back(expiry7);
-	dates.push_back(expiry8);
-	dates.push_back(expiry9);
-	dates.push_back(expiry10);
-	dates.push_back(expiry11);
-	dates.push_back(expiry12);
-	dates.push_back(expiry13);
-	dates.push_back(expiry14);
-	dates.push_back(expiry15);
-	dates.push_back(expiry16);
-	dates.push_back(expiry17);
-	dates.push_back(expiry18);
-	dates.push_back(expiry19);
-	dates.push_back(expiry20);
-	dates.push_back(expiry21);
-	dates.push_back(expiry22);
-	dates.push_back(expiry23);
-	dates.push_back(expiry24);
-	dates.push_back(expiry25);
-	dates.push_back(expiry26);
-	dates.push_back(expiry27);
-	dates.push_back(expiry28);
-	dates.push_back(expiry29);
+boost::shared_ptr<YieldTermStructure> MarketData::builddividendcurve(const MarketQuotes& market,
+	Date settlementDate, Natural fixingDays, boost::shared_ptr<YieldTermStructure> OISTermStructure) {
 
+	QL_REQUIRE(market.forwards.size() == market.forwardDates.size(), "one dividend forward per date expected");
+
+	// the q-discounts follow the OIS curve, and are recomputed when read
+	// after it changed
+	boost::shared_ptr<YieldTermStructure> dividendcurve(
+		new ImpliedDividendCurve(market.forwardDates, market.forwards, market.spot, OISTermStructure));
+
+	return dividendcurve;
+}
+
+
+std::vector<Real> MarketData::dividendforwards() {
+
+	//stock forwards at the dates of the dividend curve
 	Real forward[] = { 15.35, 15.30, 15.30, 15.30, 15.30, 15.30, 14.90, 14.90, 14.90, 14.89, 14.89, 14.89, 14.88, 14.88, 14.53, 14.53, 14.53, 14.53, 14.21, 14.21,
 		13.89, 13.89, 13.58, 13.58, 13.29, 13.29, 12.74, 12.24, 12.25, 11.80 };
 	
-	std::vector<Real> fwd(forward, forward + LENGTH(forward));
+	return std::vector<Real>(forward, forward + LENGTH(forward));
+}
 
-	std::vector<Real> qDiscount;
 
-	for (auto i = 0; i < dates.size(); ++i) {
-		
-		auto qFactor = (fwd[i] / s0)*OISTermStructure->discount(dates[i]);
-		qDiscount.push_back(qFactor);
+MarketQuotes MarketData::defaultquotes() {
 
-	}
+	MarketQuotes market;
+	market.valuationDate = Date(31, March, 2017);
+	market.spot = 15.35;
 
-	boost::shared_ptr<YieldTermStructure> dividendcurve(
-		new InterpolatedDiscountCurve<LogLinear>(dates, 
-												 qDiscount,
-												 OISTermStructure->dayCounter(),
-												 OISTermStructure->calendar()));
+	// eonia swaps
+	Period tenors[] = { 1 * Weeks, 2 * Weeks, 1 * Months, 2 * Months, 3 * Months, 4 * Months,
+		5 * Months, 6 * Months, 7 * Months, 8 * Months, 9 * Months, 10 * Months, 11 * Months,
+		1 * Years, 18 * Months, 2 * Years, 30 * Months, 3 * Years, 42 * Months, 5 * Years, 6 * Years };
+	Rate rates[] = { -0.0036, -0.0036, -0.00359, -0.00359, -0.00359, -0.00358, -0.00346,
+		-0.00355, -0.00353, -0.00348, -0.00344, -0.00341, -0.00336, -0.00331, -0.00297,
+		-0.00253, -0.00211, -0.00145, -0.00037, -0.00082, -0.00216 };
+	market.OISTenors.assign(tenors, tenors + LENGTH(tenors));
+	market.OISRates.assign(rates, rates + LENGTH(rates));
+
+	// coupon bonds
+	Date issueDates[] = {Date(03 , October , 2012),
+		Date(05 , November , 2012),
+		Date(16 , January , 2013),
+		Date(12 , February , 2003),
+		Date(8 , May , 2008),
+		Date(24 , September , 2013),
+		Date(11 , December , 2013),
+		Date(01 , March , 1999),
+		Date(23 , September , 2009),
+		Date(28 , January , 2010),
+		Date(14 , April , 2010),
+		Date(16 , July , 2012),
+		Date(14 , July , 2016),
+		Date(19 , February , 2010),
+		Date(18 , January , 2017) };
+
+	Date maturityDates[] = {Date(03 , October , 2017),
+		Date(05 , November, 2017),
+		Date(16 , January, 2018),
+		Date(12 , February, 2018),
+		Date(8 , May , 2018),
+		Date(24 , September , 2018),
+		Date(11 , December , 2018),
+		Date(01 , March , 2019),
+		Date(23 , September , 2019),
+		Date(28 , January , 2020),
+		Date(14 , April , 2020),
+		Date(27 , January , 2021),
+		Date(14 , July , 2021),
+		Date(19 , February , 2023),
+		Date(18 , January  , 2024) };
 	
-	return dividendcurve;
-}
\ No newline at end of file
+	Real couponRates[] = { 0.048, 0.04, 0.033, 0.049, 0.06625, 0.0225, 0.02, 0.046, 0.05, 0.0435, 0.04125, 0.05, 0.01015, 0.0463, 0.01375 } ;
+	Real marketQuotes[] = { 102.36,	102.326, 101.154, 103.848, 106.723, 103.598, 102.531, 108.286, 108.708, 109.181, 110.579, 118.708, 100.588,	116.948, 99.127};
+	market.bondIssueDates.assign(issueDates, issueDates + LENGTH(issueDates));
+	market.bondMaturityDates.assign(maturityDates, maturityDates + LENGTH(maturityDates));
+	market.bondCoupons.assign(couponRates, couponRates + LENGTH(couponRates));
+	market.bondPrices.assign(marketQuotes, marketQuotes + LENGTH(marketQuotes));
+
+	// stock forwards: the first one before the volatility expiries
+	market.volExpiries = blackvolexpiries();
+	market.forwardDates.push_back(Date(04, April, 2017));
+	market.forwardDates.insert(market.forwardDates.end(), market.volExpiries.begin(), market.volExpiries.end());
+	market.forwards = dividendforwards();
+
+	market.volStrikes = blackvolstrikes();
+	market.vols = blackvolmatrix();
+
+	return market;
+}
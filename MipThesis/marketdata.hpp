@@ -6,24 +6,63 @@
 #define LENGTH(a) (sizeof(a)/sizeof(a[0]))
 
 #include <ql/quantlib.hpp>
+#include <flatvariancesurface.hpp>
+#include <marketquotes.hpp>
 
 using namespace QuantLib;
 
 
 struct MarketData {
 
+	// the quotes of 31 March 2017 the builders without a MarketQuotes
+	// argument are based on
+	static MarketQuotes defaultquotes();
 
+	// the builders below take their quotes from a MarketQuotes, e.g. one
+	// of the valuation dates of a market data file
+
+	static boost::shared_ptr<YieldTermStructure>
+		builddiscountingcurve(Date settlementDate, Natural fixingDays,
+			std::vector<boost::shared_ptr<SimpleQuote> >* quotes = 0);
 	static boost::shared_ptr<YieldTermStructure>
-		builddiscountingcurve(Date settlementDate, Natural fixingDays);
+		builddiscountingcurve(const MarketQuotes& market, Date settlementDate, Natural fixingDays,
+			std::vector<boost::shared_ptr<SimpleQuote> >* quotes = 0);
+	// the same curve settling fixingDays after the evaluation date, which
+	// follows it as it moves; the quotes are then moved to each new date
+	static boost::shared_ptr<YieldTermStructure>
+		buildmovingdiscountingcurve(const MarketQuotes& market, Natural fixingDays, Calendar calendar,
+			std::vector<boost::shared_ptr<SimpleQuote> >* quotes = 0);
 
-	static boost::shared_ptr<BlackVarianceSurface>
+	static boost::shared_ptr<FlatBlackVarianceSurface>
 		buildblackvariancesurface(Date settlementDate, Calendar calendar);
+	static boost::shared_ptr<FlatBlackVarianceSurface>
+		buildblackvariancesurface(const MarketQuotes& market, Date settlementDate, Calendar calendar);
+
+	// the same surface on other volatilities, strikes along the rows and
+	// expiries along the columns as in blackvolmatrix()
+	static boost::shared_ptr<FlatBlackVarianceSurface>
+		buildblackvariancesurface(Date settlementDate, Calendar calendar, const Matrix& blackVolMatrix);
 
+	// the quotes the surface is built on
+	static Matrix blackvolmatrix();
+	static std::vector<Date> blackvolexpiries();
+	static std::vector<Real> blackvolstrikes();
+
+	static boost::shared_ptr<YieldTermStructure>
+		buildbonddiscountingurve(Date settlementDate, Natural fixingDays,
+			std::vector<boost::shared_ptr<SimpleQuote> >* quotes = 0);
 	static boost::shared_ptr<YieldTermStructure>
-		buildbonddiscountingurve(Date settlementDate, Natural fixingDays);
+		buildbonddiscountingurve(const MarketQuotes& market, Date settlementDate, Natural fixingDays,
+			std::vector<boost::shared_ptr<SimpleQuote> >* quotes = 0);
 
 	static boost::shared_ptr<YieldTermStructure>
 		builddividendcurve(Date settlementDate, Natural fixingDays, boost::shared_ptr<YieldTermStructure> OISTermStructure);
+	static boost::shared_ptr<YieldTermStructure>
+		builddividendcurve(const MarketQuotes& market, Date settlementDate, Natural fixingDays,
+			boost::shared_ptr<YieldTermStructure> OISTermStructure);
+
+	// the stock forwards the dividend curve is implied from
+	static std::vector<Real> dividendforwards();
 
 
 };
@@ -0,0 +1,211 @@
+#include <ql/quantlib.hpp>
+#include <marketquotes.hpp>
+#include <csvrecords.hpp>
+#include <fstream>
+#include <iomanip>
+#include <set>
+
+using namespace QuantLib;
+
+namespace {
+
+	// the values after the record's name, parsed one by one
+	template <class T, class Parse>
+	void parseColumn(const std::vector<std::string>& fields, std::vector<T>& column, Parse parse) {
+		column.clear();
+		column.reserve(fields.size() - 1);
+		for (Size i = 1; i < fields.size(); i++)
+			column.push_back(parse(fields[i]));
+	}
+
+	template <class T>
+	void writeColumn(std::ostream& out, const char* name, const std::vector<T>& column) {
+		out << name;
+		for (auto const& value : column)
+			out << "," << value;
+		out << "\n";
+	}
+
+	void writeColumn(std::ostream& out, const char* name, const std::vector<Date>& column) {
+		out << name;
+		for (auto const& d : column)
+			out << "," << io::iso_date(d);
+		out << "\n";
+	}
+
+	void writeColumn(std::ostream& out, const char* name, const std::vector<Period>& column) {
+		static const char units[] = { 'D', 'W', 'M', 'Y' };
+		out << name;
+		for (auto const& p : column)
+			out << "," << p.length() << units[p.units()];
+		out << "\n";
+	}
+
+	template <class T>
+	void requireIncreasing(const std::vector<T>& column, const char* what) {
+		for (Size i = 1; i < column.size(); i++)
+			QL_REQUIRE(column[i - 1] < column[i], what << " must increase");
+	}
+
+}
+
+std::vector<MarketQuotes> loadMarketQuotes(const std::string& fileName) {
+	std::ifstream in(fileName.c_str());
+	QL_REQUIRE(in, "cannot open the market data file " << fileName);
+
+	std::vector<MarketQuotes> history;
+	std::vector<std::vector<Real> > volRows;
+	std::set<std::string> seen;
+	Size line = 0, blockLine = 0;
+
+	// the checks of a block, once all its records are read
+	auto closeBlock = [&]() {
+		if (history.empty())
+			return;
+		MarketQuotes& quotes = history.back();
+		try {
+			static const char* required[] = { "spot", "ois.tenors", "ois.rates",
+				"bond.issues", "bond.maturities", "bond.coupons", "bond.prices",
+				"forward.dates", "forward.values", "vol.expiries", "vol.strikes" };
+			for (auto const& name : required)
+				QL_REQUIRE(seen.count(name) > 0, "no " << name << " record");
+			QL_REQUIRE(!volRows.empty(), "no vol records");
+			quotes.vols = Matrix(volRows.size(), volRows[0].size());
+			for (Size i = 0; i < volRows.size(); i++) {
+				QL_REQUIRE(volRows[i].size() == quotes.vols.columns(),
+					"vol record " << i + 1 << " has " << volRows[i].size() << " values, "
+					<< quotes.vols.columns() << " expected");
+				std::copy(volRows[i].begin(), volRows[i].end(), quotes.vols.row_begin(i));
+			}
+			validateMarketQuotes(quotes);
+			QL_REQUIRE(history.size() == 1 || quotes.valuationDate > history[history.size() - 2].valuationDate,
+				"the valuation dates must increase");
+		}
+		catch (std::exception& e) {
+			QL_FAIL(fileName << ", valuation at line " << blockLine << ": " << e.what());
+		}
+	};
+
+	std::vector<std::string> fields;
+	while (readRecord(in, fields, line)) {
+		const std::string kind = fields[0];
+		if (kind == "valuation")
+			closeBlock();
+		try {
+			if (kind == "valuation") {
+				QL_REQUIRE(fields.size() == 2, "a valuation record has 2 fields, " << fields.size() << " found");
+				history.push_back(MarketQuotes());
+				history.back().valuationDate = parseDate(fields[1]);
+				seen.clear();
+				volRows.clear();
+				blockLine = line;
+				continue;
+			}
+			QL_REQUIRE(!history.empty(), "a valuation record must come first");
+			QL_REQUIRE(fields.size() > 1, "record '" << kind << "' without values");
+			QL_REQUIRE(kind == "vol" || seen.insert(kind).second, "duplicate record '" << kind << "'");
+
+			MarketQuotes& quotes = history.back();
+			auto real = [&](const std::string& field) { return parseReal(field, kind.c_str()); };
+			if (kind == "spot") {
+				QL_REQUIRE(fields.size() == 2, "a spot record has 2 fields, " << fields.size() << " found");
+				quotes.spot = real(fields[1]);
+			}
+			else if (kind == "ois.tenors")
+				parseColumn(fields, quotes.OISTenors, parsePeriod);
+			else if (kind == "ois.rates")
+				parseColumn(fields, quotes.OISRates, real);
+			else if (kind == "bond.issues")
+				parseColumn(fields, quotes.bondIssueDates, parseDate);
+			else if (kind == "bond.maturities")
+				parseColumn(fields, quotes.bondMaturityDates, parseDate);
+			else if (kind == "bond.coupons")
+				parseColumn(fields, quotes.bondCoupons, real);
+			else if (kind == "bond.prices")
+				parseColumn(fields, quotes.bondPrices, real);
+			else if (kind == "forward.dates")
+				parseColumn(fields, quotes.forwardDates, parseDate);
+			else if (kind == "forward.values")
+				parseColumn(fields, quotes.forwards, real);
+			else if (kind == "vol.expiries")
+				parseColumn(fields, quotes.volExpiries, parseDate);
+			else if (kind == "vol.strikes")
+				parseColumn(fields, quotes.volStrikes, real);
+			else if (kind == "vol") {
+				volRows.push_back(std::vector<Real>());
+				parseColumn(fields, volRows.back(), real);
+			}
+			else
+				QL_FAIL("unknown record '" << kind << "'");
+		}
+		catch (std::exception& e) {
+			QL_FAIL(fileName << ", line " << line << ": " << e.what());
+		}
+	}
+	closeBlock();
+
+	QL_REQUIRE(!history.empty(), "no valuation dates in " << fileName);
+	return history;
+}
+
+void writeMarketQuotes(std::ostream& out, const MarketQuotes& quotes) {
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision(12);
+	out.unsetf(std::ios::floatfield);
+
+	out << "valuation," << io::iso_date(quotes.valuationDate) << "\n";
+	out << "spot," << quotes.spot << "\n";
+	writeColumn(out, "ois.tenors", quotes.OISTenors);
+	writeColumn(out, "ois.rates", quotes.OISRates);
+	writeColumn(out, "bond.issues", quotes.bondIssueDates);
+	writeColumn(out, "bond.maturities", quotes.bondMaturityDates);
+	writeColumn(out, "bond.coupons", quotes.bondCoupons);
+	writeColumn(out, "bond.prices", quotes.bondPrices);
+	writeColumn(out, "forward.dates", quotes.forwardDates);
+	writeColumn(out, "forward.values", quotes.forwards);
+	writeColumn(out, "vol.expiries", quotes.volExpiries);
+	writeColumn(out, "vol.strikes", quotes.volStrikes);
+	for (Size i = 0; i < quotes.vols.rows(); i++)
+		writeColumn(out, "vol", std::vector<Real>(quotes.vols.row_begin(i), quotes.vols.row_end(i)));
+
+	out.precision(precision);
+	out.flags(flags);
+}
+
+void validateMarketQuotes(const MarketQuotes& quotes) {
+	QL_REQUIRE(quotes.spot > 0.0, "the spot must be positive");
+
+	QL_REQUIRE(!quotes.OISTenors.empty() && quotes.OISTenors.size() == quotes.OISRates.size(),
+		quotes.OISTenors.size() << " OIS tenors and " << quotes.OISRates.size() << " rates");
+	requireIncreasing(quotes.OISTenors, "the OIS tenors");
+
+	Size nBonds = quotes.bondIssueDates.size();
+	QL_REQUIRE(nBonds > 0 && quotes.bondMaturityDates.size() == nBonds
+		&& quotes.bondCoupons.size() == nBonds && quotes.bondPrices.size() == nBonds,
+		"the bond columns must have the same, non null, length");
+	requireIncreasing(quotes.bondMaturityDates, "the bond maturities");
+	QL_REQUIRE(quotes.bondMaturityDates.front() > quotes.valuationDate, "bond matured before the valuation date");
+	for (Size i = 0; i < nBonds; i++) {
+		QL_REQUIRE(quotes.bondIssueDates[i] < quotes.bondMaturityDates[i], "bond " << i + 1 << " issued after its maturity");
+		QL_REQUIRE(quotes.bondPrices[i] > 0.0, "bond " << i + 1 << ": the price must be positive");
+	}
+
+	QL_REQUIRE(!quotes.forwardDates.empty() && quotes.forwardDates.size() == quotes.forwards.size(),
+		quotes.forwardDates.size() << " forward dates and " << quotes.forwards.size() << " forwards");
+	requireIncreasing(quotes.forwardDates, "the forward dates");
+	QL_REQUIRE(quotes.forwardDates.front() > quotes.valuationDate, "forward date before the valuation date");
+	for (auto const& f : quotes.forwards)
+		QL_REQUIRE(f > 0.0, "the forwards must be positive");
+
+	QL_REQUIRE(!quotes.volExpiries.empty() && !quotes.volStrikes.empty(), "no volatility expiries or strikes");
+	requireIncreasing(quotes.volExpiries, "the volatility expiries");
+	requireIncreasing(quotes.volStrikes, "the volatility strikes");
+	QL_REQUIRE(quotes.volExpiries.front() > quotes.valuationDate, "volatility expiry before the valuation date");
+	QL_REQUIRE(quotes.volStrikes.front() > 0.0, "the strikes must be positive");
+	QL_REQUIRE(quotes.vols.rows() == quotes.volStrikes.size() && quotes.vols.columns() == quotes.volExpiries.size(),
+		"volatility matrix is " << quotes.vols.rows() << "x" << quotes.vols.columns() << ", "
+		<< quotes.volStrikes.size() << "x" << quotes.volExpiries.size() << " expected");
+	for (Size i = 0; i < quotes.vols.rows(); i++)
+		for (Size j = 0; j < quotes.vols.columns(); j++)
+			QL_REQUIRE(quotes.vols[i][j] > 0.0, "the volatilities must be positive");
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef market_quotes_hpp
+#define market_quotes_hpp
+
+#include <ql/quantlib.hpp>
+#include <iosfwd>
+
+using namespace QuantLib;
+
+/* The market quotes of a valuation date, from which MarketData builds the
+curves and the volatility surface: each kind of data is a set of columns
+of plain values, one entry per instrument. */
+struct MarketQuotes {
+	Date valuationDate;
+	Real spot;
+	// OIS swaps: tenor and rate
+	std::vector<Period> OISTenors;
+	std::vector<Rate> OISRates;
+	// fixed rate bonds, paying annual coupons: issue and maturity dates,
+	// coupon rate and clean price
+	std::vector<Date> bondIssueDates;
+	std::vector<Date> bondMaturityDates;
+	std::vector<Rate> bondCoupons;
+	std::vector<Real> bondPrices;
+	// stock forwards the dividend curve is implied from
+	std::vector<Date> forwardDates;
+	std::vector<Real> forwards;
+	// Black volatilities, strikes along the rows and expiries along the columns
+	std::vector<Date> volExpiries;
+	std::vector<Real> volStrikes;
+	Matrix vols;
+};
+
+/* Market data files hold any number of valuation dates, in increasing
+order, each one as a block of records whose fields after the first are a
+column of values:
+
+	valuation,<date>
+	spot,<spot>
+	ois.tenors,<tenors>...          e.g. 1W,2W,1M,...,18M,...,6Y
+	ois.rates,<rates>...
+	bond.issues,<dates>...
+	bond.maturities,<dates>...
+	bond.coupons,<rates>...
+	bond.prices,<clean prices>...
+	forward.dates,<dates>...
+	forward.values,<forwards>...
+	vol.expiries,<dates>...
+	vol.strikes,<strikes>...
+	vol,<volatilities at the expiries>...    one record per strike, in order
+
+the dates being given as yyyy-mm-dd. Blank lines and lines starting with
+'#' are skipped. All the blocks are read in one pass, and each one is
+checked by validateMarketQuotes(); errors give the file and the line.
+*/
+std::vector<MarketQuotes> loadMarketQuotes(const std::string& fileName);
+
+// writes a block of the format above
+void writeMarketQuotes(std::ostream& out, const MarketQuotes& quotes);
+
+// checks that the columns of each kind of data have the same length, that
+// the dates of each column increase past the valuation date and that the
+// spot, prices, forwards, strikes and volatilities are positive
+void validateMarketQuotes(const MarketQuotes& quotes);
+
+#endif // !market_quotes_hpp
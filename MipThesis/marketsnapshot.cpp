@@ -0,0 +1,272 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <ql/quantlib.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <marketsnapshot.hpp>
+#include <marketdata.hpp>
+#include <incrementaldiscountcurve.hpp>
+#include <implieddividendcurve.hpp>
+
+using namespace QuantLib;
+
+namespace {
+
+	// the file is a header followed by the payload, a sequence of 8-byte
+	// reals: dates are stored as their serial numbers
+	const char snapshotMagic[8] = { 'M', 'I', 'P', 'S', 'N', 'A', 'P', '\0' };
+	const boost::uint32_t snapshotVersion = 1;
+
+	struct SnapshotHeader {
+		char magic[8];
+		boost::uint32_t version;
+		boost::uint32_t reserved;
+		// MarketSnapshot::fingerprint() of the quotes
+		boost::uint64_t fingerprint;
+		// reals in the payload, and their checksum
+		boost::uint64_t payloadSize;
+		boost::uint64_t checksum;
+	};
+
+	// 64-bit FNV-1a hash
+	class Hash {
+		public:
+			void add(const void* data, std::size_t size) {
+				const unsigned char* bytes = static_cast<const unsigned char*>(data);
+				for (std::size_t i = 0; i < size; i++) {
+					value_ ^= bytes[i];
+					value_ *= 0x100000001B3ULL;
+				}
+			}
+			void add(Real x) { add(&x, sizeof(x)); }
+			boost::uint64_t value() const { return value_; }
+		private:
+			boost::uint64_t value_ = 0xCBF29CE484222325ULL;
+	};
+
+	// the solved nodes of a curve interpolating its discount factors
+	template <class Curve>
+	std::vector<std::pair<Date, Real> > curveNodes(const boost::shared_ptr<YieldTermStructure>& curve) {
+		boost::shared_ptr<Curve> nodesCurve = boost::dynamic_pointer_cast<Curve>(curve);
+		QL_REQUIRE(nodesCurve, "unexpected curve type in the market data");
+		return nodesCurve->nodes();
+	}
+
+	void putDates(std::vector<Real>& payload, const std::vector<Date>& dates) {
+		for (Size i = 0; i < dates.size(); i++)
+			payload.push_back(dates[i].serialNumber());
+	}
+
+	// reads the payload in order, failing past its end
+	class PayloadReader {
+		public:
+			PayloadReader(const Real* begin, Size size) : data_(begin), end_(begin + size) {}
+			Real next() {
+				QL_REQUIRE(data_ < end_, "market snapshot shorter than its contents");
+				return *data_++;
+			}
+			Size nextSize() { return Size(next()); }
+			Date nextDate() { return Date(BigInteger(next())); }
+			bool done() const { return data_ == end_; }
+		private:
+			const Real* data_;
+			const Real* end_;
+	};
+
+}
+
+
+MarketSnapshot MarketSnapshot::bootstrap(Date settlementDate, Natural fixingDays, Calendar calendar) {
+
+	MarketSnapshot snapshot(settlementDate, calendar, fingerprint(settlementDate, fixingDays));
+
+	auto OISTermStructure = MarketData::builddiscountingcurve(settlementDate, fixingDays);
+	auto bondTermStructure = MarketData::buildbonddiscountingurve(settlementDate, fixingDays);
+	auto qTermStructure = MarketData::builddividendcurve(settlementDate, fixingDays, OISTermStructure);
+
+	std::vector<std::pair<Date, Real> > nodes[] = {
+		curveNodes<IncrementalDiscountCurve>(OISTermStructure),
+		curveNodes<PiecewiseYieldCurve<Discount, LogLinear> >(bondTermStructure),
+		curveNodes<ImpliedDividendCurve>(qTermStructure) };
+	CurveNodes* curves[] = { &snapshot.OISNodes_, &snapshot.bondNodes_, &snapshot.dividendNodes_ };
+	for (Size c = 0; c < LENGTH(curves); c++)
+		for (Size i = 0; i < nodes[c].size(); i++) {
+			curves[c]->dates.push_back(nodes[c][i].first);
+			curves[c]->discounts.push_back(nodes[c][i].second);
+		}
+
+	snapshot.expiries_ = MarketData::blackvolexpiries();
+	snapshot.strikes_ = MarketData::blackvolstrikes();
+	snapshot.blackVolMatrix_ = MarketData::blackvolmatrix();
+
+	return snapshot;
+}
+
+
+void MarketSnapshot::save(const std::string& fileName) const {
+
+	// settlement date, the three curves, then the volatilities
+	std::vector<Real> payload(1, settlementDate_.serialNumber());
+	const CurveNodes* curves[] = { &OISNodes_, &bondNodes_, &dividendNodes_ };
+	for (Size c = 0; c < LENGTH(curves); c++) {
+		payload.push_back(curves[c]->dates.size());
+		putDates(payload, curves[c]->dates);
+		payload.insert(payload.end(), curves[c]->discounts.begin(), curves[c]->discounts.end());
+	}
+	payload.push_back(expiries_.size());
+	payload.push_back(strikes_.size());
+	putDates(payload, expiries_);
+	payload.insert(payload.end(), strikes_.begin(), strikes_.end());
+	payload.insert(payload.end(), blackVolMatrix_.begin(), blackVolMatrix_.end());
+
+	SnapshotHeader header;
+	std::memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+	header.version = snapshotVersion;
+	header.reserved = 0;
+	header.fingerprint = fingerprint_;
+	header.payloadSize = payload.size();
+	Hash checksum;
+	checksum.add(&payload[0], payload.size() * sizeof(Real));
+	header.checksum = checksum.value();
+
+	// written aside and then renamed, so that a process mapping the file
+	// never sees it half written
+	std::string partialName = fileName + ".partial";
+	{
+		std::ofstream file(partialName.c_str(), std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&payload[0]), payload.size() * sizeof(Real));
+		QL_REQUIRE(file, "cannot write the market snapshot " << partialName);
+	}
+	std::remove(fileName.c_str());
+	QL_REQUIRE(std::rename(partialName.c_str(), fileName.c_str()) == 0,
+		"cannot rename " << partialName << " to " << fileName);
+}
+
+
+MarketSnapshot MarketSnapshot::load(const std::string& fileName,
+	Date settlementDate, Natural fixingDays, Calendar calendar) {
+
+	using namespace boost::interprocess;
+	file_mapping file(fileName.c_str(), read_only);
+	mapped_region region(file, read_only);
+	const char* data = static_cast<const char*>(region.get_address());
+	std::size_t size = region.get_size();
+
+	SnapshotHeader header;
+	QL_REQUIRE(size >= sizeof(header), fileName << " is not a market snapshot");
+	std::memcpy(&header, data, sizeof(header));
+	QL_REQUIRE(std::memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) == 0,
+		fileName << " is not a market snapshot");
+	QL_REQUIRE(header.version == snapshotVersion,
+		fileName << " has format version " << header.version << ", " << snapshotVersion << " expected");
+	QL_REQUIRE(size == sizeof(header) + header.payloadSize * sizeof(Real),
+		fileName << " is truncated");
+
+	// the mapping is page aligned and the header a multiple of 8 bytes long:
+	// the payload is read in place
+	const Real* payload = reinterpret_cast<const Real*>(data + sizeof(header));
+	Hash checksum;
+	checksum.add(payload, header.payloadSize * sizeof(Real));
+	QL_REQUIRE(checksum.value() == header.checksum, fileName << " is corrupted: wrong checksum");
+	QL_REQUIRE(header.fingerprint == fingerprint(settlementDate, fixingDays),
+		fileName << " is stale: it was taken on other market quotes or settings");
+
+	MarketSnapshot snapshot(settlementDate, calendar, header.fingerprint);
+	PayloadReader reader(payload, header.payloadSize);
+	QL_REQUIRE(reader.nextDate() == settlementDate, fileName << " has another settlement date");
+	CurveNodes* curves[] = { &snapshot.OISNodes_, &snapshot.bondNodes_, &snapshot.dividendNodes_ };
+	for (Size c = 0; c < LENGTH(curves); c++) {
+		Size n = reader.nextSize();
+		for (Size i = 0; i < n; i++)
+			curves[c]->dates.push_back(reader.nextDate());
+		for (Size i = 0; i < n; i++)
+			curves[c]->discounts.push_back(reader.next());
+	}
+	Size nExpiries = reader.nextSize(), nStrikes = reader.nextSize();
+	for (Size j = 0; j < nExpiries; j++)
+		snapshot.expiries_.push_back(reader.nextDate());
+	for (Size i = 0; i < nStrikes; i++)
+		snapshot.strikes_.push_back(reader.next());
+	snapshot.blackVolMatrix_ = Matrix(nStrikes, nExpiries);
+	for (Matrix::iterator v = snapshot.blackVolMatrix_.begin(); v != snapshot.blackVolMatrix_.end(); ++v)
+		*v = reader.next();
+	QL_REQUIRE(reader.done(), fileName << " is longer than its contents");
+
+	return snapshot;
+}
+
+
+MarketSnapshot MarketSnapshot::cached(const std::string& fileName,
+	Date settlementDate, Natural fixingDays, Calendar calendar) {
+	try {
+		return load(fileName, settlementDate, fixingDays, calendar);
+	}
+	catch (std::exception& e) {
+		std::cout << "Market snapshot not used (" << e.what() << "): bootstrapping the curves" << std::endl;
+	}
+	MarketSnapshot snapshot = bootstrap(settlementDate, fixingDays, calendar);
+	snapshot.save(fileName);
+	return snapshot;
+}
+
+
+boost::shared_ptr<YieldTermStructure> MarketSnapshot::curve(const CurveNodes& nodes) {
+	// the day counter of the MarketData curves
+	return boost::shared_ptr<YieldTermStructure>(
+		new InterpolatedDiscountCurve<LogLinear>(nodes.dates, nodes.discounts,
+			ActualActual(ActualActual::ISDA)));
+}
+
+boost::shared_ptr<YieldTermStructure> MarketSnapshot::discountingCurve() const {
+	return curve(OISNodes_);
+}
+
+boost::shared_ptr<YieldTermStructure> MarketSnapshot::bondDiscountingCurve() const {
+	return curve(bondNodes_);
+}
+
+boost::shared_ptr<YieldTermStructure> MarketSnapshot::dividendCurve() const {
+	return curve(dividendNodes_);
+}
+
+boost::shared_ptr<FlatBlackVarianceSurface> MarketSnapshot::blackVarianceSurface() const {
+	boost::shared_ptr<FlatBlackVarianceSurface> varTS(
+		new FlatBlackVarianceSurface(settlementDate_, calendar_, expiries_, strikes_,
+			blackVolMatrix_, Actual365Fixed()));
+	varTS->enableExtrapolation(true);
+	return varTS;
+}
+
+
+boost::uint64_t MarketSnapshot::fingerprint(Date settlementDate, Natural fixingDays) {
+
+	Hash hash;
+	hash.add(Real(snapshotVersion));
+	hash.add(Real(settlementDate.serialNumber()));
+	hash.add(Real(fixingDays));
+
+	// the curves are only built to read their quotes: their bootstrap is
+	// lazy and is not triggered here
+	std::vector<boost::shared_ptr<SimpleQuote> > quotes;
+	MarketData::builddiscountingcurve(settlementDate, fixingDays, &quotes);
+	for (Size i = 0; i < quotes.size(); i++)
+		hash.add(quotes[i]->value());
+	MarketData::buildbonddiscountingurve(settlementDate, fixingDays, &quotes);
+	for (Size i = 0; i < quotes.size(); i++)
+		hash.add(quotes[i]->value());
+
+	std::vector<Real> forwards = MarketData::dividendforwards();
+	hash.add(&forwards[0], forwards.size() * sizeof(Real));
+	std::vector<Date> expiries = MarketData::blackvolexpiries();
+	for (Size j = 0; j < expiries.size(); j++)
+		hash.add(Real(expiries[j].serialNumber()));
+	std::vector<Real> strikes = MarketData::blackvolstrikes();
+	hash.add(&strikes[0], strikes.size() * sizeof(Real));
+	Matrix vols = MarketData::blackvolmatrix();
+	hash.add(vols.begin(), vols.rows() * vols.columns() * sizeof(Real));
+
+	return hash.value();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#ifndef market_snapshot_hpp
+#define market_snapshot_hpp
+
+#include <ql/quantlib.hpp>
+#include <flatvariancesurface.hpp>
+#include <string>
+
+using namespace QuantLib;
+
+/* The market data of MarketData, bootstrapped once and stored as solved
+nodes: the dates and discount factors of the OIS, bond and dividend curves
+and the Black volatility matrix.
+
+A snapshot is saved to a compact binary file; later runs map the file
+and rebuild the curves on the stored nodes, with the same log-linear
+interpolation of the discount factors, instead of bootstrapping them
+again. The file carries a checksum of its contents, against truncated or
+corrupted files, and a fingerprint of the MarketData quotes it was taken
+on (settlement date, fixing days, OIS and bond quotes, dividend forwards,
+volatilities), against snapshots gone stale since the quotes changed.
+*/
+
+class MarketSnapshot {
+	public:
+		// bootstraps the MarketData curves for the settlement date
+		static MarketSnapshot bootstrap(Date settlementDate, Natural fixingDays, Calendar calendar);
+		// maps a snapshot file written by save(); corrupted files and
+		// snapshots of other settings or quotes are rejected
+		static MarketSnapshot load(const std::string& fileName,
+			Date settlementDate, Natural fixingDays, Calendar calendar);
+		// the snapshot in fileName if it is valid, otherwise a new bootstrap
+		// which replaces the file
+		static MarketSnapshot cached(const std::string& fileName,
+			Date settlementDate, Natural fixingDays, Calendar calendar);
+
+		void save(const std::string& fileName) const;
+
+		// new term structures on the stored nodes
+		boost::shared_ptr<YieldTermStructure> discountingCurve() const;
+		boost::shared_ptr<YieldTermStructure> bondDiscountingCurve() const;
+		boost::shared_ptr<YieldTermStructure> dividendCurve() const;
+		boost::shared_ptr<FlatBlackVarianceSurface> blackVarianceSurface() const;
+
+		Date settlementDate() const { return settlementDate_; }
+
+	private:
+		struct CurveNodes {
+			std::vector<Date> dates;
+			std::vector<DiscountFactor> discounts;
+		};
+
+		MarketSnapshot(Date settlementDate, Calendar calendar, boost::uint64_t fingerprint)
+			: settlementDate_(settlementDate), calendar_(calendar), fingerprint_(fingerprint) {}
+
+		// hash of the MarketData quotes and settings the curves are built on
+		static boost::uint64_t fingerprint(Date settlementDate, Natural fixingDays);
+		static boost::shared_ptr<YieldTermStructure> curve(const CurveNodes& nodes);
+
+		Date settlementDate_;
+		Calendar calendar_;
+		boost::uint64_t fingerprint_;
+		CurveNodes OISNodes_, bondNodes_, dividendNodes_;
+		std::vector<Date> expiries_;
+		std::vector<Real> strikes_;
+		Matrix blackVolMatrix_;
+};
+
+#endif // !market_snapshot_hpp
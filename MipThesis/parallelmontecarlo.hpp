@@ -0,0 +1,108 @@
+#pragma once
+
+#ifndef parallel_monte_carlo_hpp
+#define parallel_monte_carlo_hpp
+
+#include <ql/quantlib.hpp>
+#include <atomic>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace QuantLib;
+
+/* Helpers used by the simulators to spread the Monte Carlo samples over
+several worker threads.
+
+The QuantLib objects used by a worker (stochastic process, path generator,
+path pricer) must be built by the calling thread before the workers are
+started: registering observers on the shared term structures is not
+thread-safe, while reading an already calculated curve is.
+*/
+
+// Number of workers to be used when the caller asks for 0 threads
+inline Size defaultThreads() {
+	Size n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+// Seed of the i-th random stream derived from a master seed.
+// The stream counter is mixed with the splitmix64 finalizer, so that
+// neighbouring streams get uncorrelated Mersenne Twister initializations.
+inline BigNatural streamSeed(BigNatural masterSeed, Size stream) {
+	boost::uint64_t z = (boost::uint64_t(masterSeed) << 32) + stream + 1;
+	z *= 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z = z ^ (z >> 31);
+	// a null seed would ask QuantLib for a random one
+	BigNatural seed = BigNatural(z & 0xFFFFFFFFUL);
+	return seed != 0 ? seed : 1;
+}
+
+// Appends the samples of a partial accumulator to the total one.
+// Statistics keeps the whole sample set, so merging the partials in a
+// fixed order gives the same figures as a serial run over that order.
+inline void mergeStatistics(Statistics& total, const Statistics& partial) {
+	const std::vector<std::pair<Real, Real> >& samples = partial.data();
+	for (Size i = 0; i < samples.size(); ++i)
+		total.add(samples[i].first, samples[i].second);
+}
+
+// Runs task(i) for i = 0..nThreads-1, each on its own thread, and waits
+// for all of them. The first exception thrown by a worker is rethrown.
+template <class Task>
+void runOnThreads(Size nThreads, Task task) {
+
+	if (nThreads == 1) {
+		task(Size(0));
+		return;
+	}
+
+	std::vector<std::exception_ptr> errors(nThreads);
+	std::vector<std::thread> workers;
+	workers.reserve(nThreads);
+	for (Size i = 0; i < nThreads; ++i) {
+		workers.push_back(std::thread([&task, &errors, i]() {
+			try {
+				task(i);
+			}
+			catch (...) {
+				errors[i] = std::current_exception();
+			}
+		}));
+	}
+	for (Size i = 0; i < nThreads; ++i)
+		workers[i].join();
+
+	for (Size i = 0; i < nThreads; ++i)
+		if (errors[i])
+			std::rethrow_exception(errors[i]);
+}
+
+// Runs task(batch, worker) for batch = 0..nBatches-1 on nThreads workers.
+// Each worker pulls the next pending batch from a shared counter when it is
+// done with the previous one, so faster workers take over the remaining
+// load. Whatever depends on the batch index only (its seed, its slot for
+// the results) is thus independent of the number of workers.
+template <class Task>
+void runBatches(Size nBatches, Size nThreads, Task task) {
+	std::atomic<Size> nextBatch(0);
+	runOnThreads(nThreads, [&](Size worker) {
+		for (Size batch = nextBatch++; batch < nBatches; batch = nextBatch++)
+			task(batch, worker);
+	});
+}
+
+// One line of the convergence trace of a tolerance-driven run
+inline void printConvergence(Size samples, Real mean, Real error, double seconds) {
+	std::cout << std::fixed
+		<< "  samples " << std::setw(8) << samples
+		<< " | mean " << std::setw(12) << std::setprecision(4) << mean
+		<< " | error " << std::setw(10) << std::setprecision(4) << error
+		<< " | " << std::setw(8) << std::setprecision(2) << seconds << " s" << std::endl;
+}
+
+#endif // !parallel_monte_carlo_hpp
@@ -0,0 +1,247 @@
+#include <ql/quantlib.hpp>
+#include <pathkernel.hpp>
+
+using namespace QuantLib;
+
+PathKernel::PathKernel(const boost::shared_ptr<StochasticProcess>& process,
+					   const TimeGrid& timeGrid,
+					   HestonScheme hestonScheme)
+	: v0_(0.0), kappa_(0.0), theta_(0.0), sigma_(0.0), rho_(0.0), hestonScheme_(hestonScheme) {
+
+	Size steps = timeGrid.size() - 1;
+	QL_REQUIRE(steps > 0, "the time grid has no steps");
+
+	drifts_.reserve(steps);
+	diffusions_.reserve(steps);
+	dts_.reserve(steps);
+
+	auto bs = boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(process);
+	if (bs)
+		localVolatility_ = boost::dynamic_pointer_cast<CachedLocalVolSurface>(
+			bs->localVolatility().currentLink());
+
+	if (localVolatility_) {
+
+		model_ = LocalVol;
+		factors_ = 1;
+		x0_ = bs->x0();
+
+		// the volatility depends on the spot: only the rates are integrated
+		// over the step, the variance is taken at its start on each path
+		const Handle<YieldTermStructure>& riskFreeRate = bs->riskFreeRate();
+		const Handle<YieldTermStructure>& dividendYield = bs->dividendYield();
+
+		times_.reserve(steps);
+		for (Size k = 0; k < steps; k++) {
+			Time t0 = timeGrid[k], t1 = timeGrid[k + 1];
+			Real rateDrift = std::log(riskFreeRate->discount(t0) / riskFreeRate->discount(t1))
+				- std::log(dividendYield->discount(t0) / dividendYield->discount(t1));
+			drifts_.push_back(rateDrift);
+			diffusions_.push_back(std::sqrt(t1 - t0));
+			dts_.push_back(t1 - t0);
+			times_.push_back(t0);
+		}
+	}
+	else if (bs) {
+
+		model_ = BlackScholes;
+		factors_ = 1;
+		x0_ = bs->x0();
+
+		// The rates and the volatility are deterministic: over each step the
+		// log spot is normal with the forward drift and the forward variance
+		// of the term structures, whatever the length of the step.
+		const Handle<YieldTermStructure>& riskFreeRate = bs->riskFreeRate();
+		const Handle<YieldTermStructure>& dividendYield = bs->dividendYield();
+		const Handle<BlackVolTermStructure>& volatility = bs->blackVolatility();
+
+		for (Size k = 0; k < steps; k++) {
+			Time t0 = timeGrid[k], t1 = timeGrid[k + 1];
+			Real variance = volatility->blackVariance(t1, x0_, true)
+				- volatility->blackVariance(t0, x0_, true);
+			Real rateDrift = std::log(riskFreeRate->discount(t0) / riskFreeRate->discount(t1))
+				- std::log(dividendYield->discount(t0) / dividendYield->discount(t1));
+			drifts_.push_back(rateDrift - 0.5 * variance);
+			diffusions_.push_back(std::sqrt(std::max<Real>(variance, 0.0)));
+			dts_.push_back(t1 - t0);
+		}
+	}
+	else if (auto heston = boost::dynamic_pointer_cast<HestonProcess>(process)) {
+
+		model_ = Heston;
+		factors_ = 2;
+		x0_ = heston->s0()->value();
+		v0_ = heston->v0();
+		kappa_ = heston->kappa();
+		theta_ = heston->theta();
+		sigma_ = heston->sigma();
+		rho_ = heston->rho();
+
+		const Handle<YieldTermStructure>& riskFreeRate = heston->riskFreeRate();
+		const Handle<YieldTermStructure>& dividendYield = heston->dividendYield();
+
+		for (Size k = 0; k < steps; k++) {
+			Time t0 = timeGrid[k], t1 = timeGrid[k + 1];
+			Real rateDrift = std::log(riskFreeRate->discount(t0) / riskFreeRate->discount(t1))
+				- std::log(dividendYield->discount(t0) / dividendYield->discount(t1));
+			drifts_.push_back(rateDrift);
+			diffusions_.push_back(std::sqrt(t1 - t0));
+			dts_.push_back(t1 - t0);
+		}
+	}
+	else {
+		QL_FAIL("no vectorised path kernel for the given process");
+	}
+}
+
+void PathKernel::evolve(const Real* normals, Size nPaths,
+						Real* spots, Real* workspace) const {
+	switch (model_) {
+	case BlackScholes:
+		evolveBlackScholes(normals, nPaths, spots);
+		break;
+	case Heston:
+		if (hestonScheme_ == QuadraticExponentialScheme)
+			evolveHestonQE(normals, nPaths, spots, workspace);
+		else
+			evolveHeston(normals, nPaths, spots, workspace);
+		break;
+	case LocalVol:
+		evolveLocalVol(normals, nPaths, spots, workspace);
+		break;
+	}
+}
+
+void PathKernel::evolveBlackScholes(const Real* normals, Size nPaths, Real* spots) const {
+
+	for (Size p = 0; p < nPaths; p++)
+		spots[p] = x0_;
+
+	for (Size k = 0; k < drifts_.size(); k++) {
+		const Real* z = normals + k*nPaths;
+		const Real* current = spots + k*nPaths;
+		Real* next = spots + (k + 1)*nPaths;
+		Real drift = drifts_[k], stdDev = diffusions_[k];
+		for (Size p = 0; p < nPaths; p++)
+			next[p] = current[p] * std::exp(drift + stdDev * z[p]);
+	}
+}
+
+void PathKernel::evolveHeston(const Real* normals, Size nPaths,
+							  Real* spots, Real* variances) const {
+
+	for (Size p = 0; p < nPaths; p++) {
+		spots[p] = x0_;
+		variances[p] = v0_;
+	}
+
+	Real rhoBar = std::sqrt(1.0 - rho_*rho_);
+
+	for (Size k = 0; k < drifts_.size(); k++) {
+		const Real* z1 = normals + (2 * k)*nPaths;
+		const Real* z2 = normals + (2 * k + 1)*nPaths;
+		const Real* current = spots + k*nPaths;
+		Real* next = spots + (k + 1)*nPaths;
+		Real drift = drifts_[k], dt = dts_[k], sqrtDt = diffusions_[k];
+
+		// full truncation: the variance may go negative, but only its
+		// positive part enters the drifts and the diffusions
+		for (Size p = 0; p < nPaths; p++) {
+			Real v = std::max<Real>(variances[p], 0.0);
+			Real vol = std::sqrt(v) * sqrtDt;
+			next[p] = current[p] * std::exp(drift - 0.5*v*dt + vol*z1[p]);
+			variances[p] += kappa_*(theta_ - v)*dt
+				+ sigma_*vol*(rho_*z1[p] + rhoBar*z2[p]);
+		}
+	}
+}
+
+void PathKernel::evolveHestonQE(const Real* normals, Size nPaths,
+								Real* spots, Real* variances) const {
+
+	for (Size p = 0; p < nPaths; p++) {
+		spots[p] = x0_;
+		variances[p] = v0_;
+	}
+
+	// switching level between the quadratic and the exponential branches
+	const Real psiC = 1.5;
+	// central discretization of the variance integral
+	const Real gamma1 = 0.5, gamma2 = 0.5;
+
+	for (Size k = 0; k < drifts_.size(); k++) {
+		const Real* zS = normals + (2 * k)*nPaths;
+		const Real* zV = normals + (2 * k + 1)*nPaths;
+		const Real* current = spots + k*nPaths;
+		Real* next = spots + (k + 1)*nPaths;
+		Real drift = drifts_[k], dt = dts_[k];
+
+		// moments of the variance at the end of the step, given its start:
+		// mean m = theta + (v - theta)*e, variance s2 = v*s2v + s2c
+		Real e = std::exp(-kappa_*dt);
+		Real s2v = sigma_*sigma_*e*(1.0 - e) / kappa_;
+		Real s2c = theta_*sigma_*sigma_*(1.0 - e)*(1.0 - e) / (2.0*kappa_);
+
+		// log spot increment: K0 + K1*v + K2*v' + sqrt(K3*v + K4*v')*zS
+		Real K1 = gamma1*dt*(kappa_*rho_ / sigma_ - 0.5) - rho_ / sigma_;
+		Real K2 = gamma2*dt*(kappa_*rho_ / sigma_ - 0.5) + rho_ / sigma_;
+		Real K3 = gamma1*dt*(1.0 - rho_*rho_);
+		Real K4 = gamma2*dt*(1.0 - rho_*rho_);
+		Real A = K2 + 0.5*K4;
+
+		for (Size p = 0; p < nPaths; p++) {
+			Real v = variances[p];
+			Real m = theta_ + (v - theta_)*e;
+			Real psi = (v*s2v + s2c) / (m*m);
+			Real vNext, K0;
+
+			// K0 is chosen so that the discounted spot is a martingale
+			// over the step (Andersen, section 4.2)
+			if (psi <= psiC) {
+				Real invPsi = 2.0 / psi;
+				Real b2 = invPsi - 1.0 + std::sqrt(invPsi*(invPsi - 1.0));
+				Real a = m / (1.0 + b2);
+				Real w = std::sqrt(b2) + zV[p];
+				vNext = a*w*w;
+				QL_REQUIRE(2.0*A*a < 1.0, "QE martingale correction undefined: "
+					"time step too large for the Heston parameters");
+				K0 = -A*b2*a / (1.0 - 2.0*A*a) + 0.5*std::log(1.0 - 2.0*A*a);
+			}
+			else {
+				Real prob = (psi - 1.0) / (psi + 1.0);
+				Real beta = (1.0 - prob) / m;
+				// the uniform draw of the exponential branch, from the normal one
+				Real u = 0.5 * std::erfc(-zV[p] * M_SQRT1_2);
+				vNext = u <= prob ? 0.0 : std::log((1.0 - prob) / (1.0 - u)) / beta;
+				QL_REQUIRE(A < beta, "QE martingale correction undefined: "
+					"time step too large for the Heston parameters");
+				K0 = -std::log(prob + beta*(1.0 - prob) / (beta - A));
+			}
+			K0 -= (K1 + 0.5*K3)*v;
+
+			next[p] = current[p] * std::exp(drift + K0 + K1*v + K2*vNext
+				+ std::sqrt(K3*v + K4*vNext)*zS[p]);
+			variances[p] = vNext;
+		}
+	}
+}
+
+void PathKernel::evolveLocalVol(const Real* normals, Size nPaths,
+								Real* spots, Real* vols) const {
+
+	for (Size p = 0; p < nPaths; p++)
+		spots[p] = x0_;
+
+	for (Size k = 0; k < drifts_.size(); k++) {
+		const Real* z = normals + k*nPaths;
+		const Real* current = spots + k*nPaths;
+		Real* next = spots + (k + 1)*nPaths;
+		Real drift = drifts_[k], dt = dts_[k], sqrtDt = diffusions_[k];
+
+		localVolatility_->localVols(times_[k], current, nPaths, vols);
+		for (Size p = 0; p < nPaths; p++) {
+			Real vol = vols[p];
+			next[p] = current[p] * std::exp(drift - 0.5*vol*vol*dt + vol*sqrtDt*z[p]);
+		}
+	}
+}
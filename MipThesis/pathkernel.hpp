@@ -0,0 +1,119 @@
+#pragma once
+
+#ifndef path_kernel_hpp
+#define path_kernel_hpp
+
+#include <ql/quantlib.hpp>
+#include <cachedlocalvolsurface.hpp>
+
+using namespace QuantLib;
+
+/* Vectorised path evolution for the diffusions used by the simulators.
+
+QuantLib's path generators evolve one path and one step at a time through
+the virtual StochasticProcess::evolve(). The kernel evolves a block of
+paths at once instead: at each step the same drift and diffusion
+coefficients, precomputed once per time grid, are applied to all the
+paths of the block, which are stored side by side so that the inner loop
+over the paths runs in SIMD lanes.
+
+Black&Scholes processes (BlackScholesProcess, BlackScholesMertonProcess)
+are evolved with the exact log-normal step over the term structures;
+the Heston process with a full truncation Euler scheme on the log spot,
+or with Andersen's quadratic-exponential scheme and its martingale
+correction, which keeps the bias low on far coarser grids; as in
+HestonProcess, steps too large for the correction to exist are rejected.
+A Black&Scholes process built on a CachedLocalVolSurface is evolved with
+an Euler scheme on the log spot, the local volatilities of all the paths
+being read off the surface's table in one call per step.
+*/
+
+// discretization of the Heston process in the path kernel
+enum HestonScheme {
+	FullTruncationScheme,       // Euler, full truncation of the variance
+	QuadraticExponentialScheme  // Andersen's QE with martingale correction
+};
+
+class PathKernel {
+	public:
+		// the coefficients of the process on the grid; any other process
+		// than the ones above is rejected. Heston paths default to the
+		// quadratic-exponential scheme, as HestonProcess::evolve() does
+		PathKernel(const boost::shared_ptr<StochasticProcess>& process,
+			const TimeGrid& timeGrid,
+			HestonScheme hestonScheme = QuadraticExponentialScheme);
+
+		// random factors per step: 1 for Black&Scholes, 2 for Heston
+		Size factors() const { return factors_; }
+		Size steps() const { return drifts_.size(); }
+		// Gaussian draws needed by a path
+		Size dimension() const { return factors_ * steps(); }
+
+		/* Evolves nPaths paths from the initial spot. All the arrays are
+		time-major: the draw for factor f at step k of path p is
+		normals[(k*factors() + f)*nPaths + p] and the spot of path p at grid
+		point i is written to spots[i*nPaths + p], for i = 0..steps().
+		The workspace holds the nPaths variances of the Heston model, or
+		the nPaths local volatilities of the current step. */
+		void evolve(const Real* normals, Size nPaths,
+			Real* spots, Real* workspace) const;
+
+	private:
+		void evolveBlackScholes(const Real* normals, Size nPaths, Real* spots) const;
+		void evolveHeston(const Real* normals, Size nPaths,
+			Real* spots, Real* variances) const;
+		void evolveHestonQE(const Real* normals, Size nPaths,
+			Real* spots, Real* variances) const;
+		void evolveLocalVol(const Real* normals, Size nPaths,
+			Real* spots, Real* vols) const;
+
+		enum Model { BlackScholes, Heston, LocalVol };
+		Model model_;
+		Size factors_;
+		Real x0_;
+
+		// per step: log-drift of the rates and time step; for Black&Scholes
+		// the drift includes the Ito term and diffusions_ holds the
+		// standard deviation of the log spot over the step
+		std::vector<Real> drifts_;
+		std::vector<Real> diffusions_;
+		std::vector<Time> dts_;
+		// start of each step, where the local volatility is read
+		std::vector<Time> times_;
+
+		// Heston parameters
+		Real v0_, kappa_, theta_, sigma_, rho_;
+		HestonScheme hestonScheme_;
+		// local volatility table
+		boost::shared_ptr<CachedLocalVolSurface> localVolatility_;
+};
+
+/* The buffers a worker evolves its batches in. They are sized once for
+the largest batch and reused for every batch, so that drawing and evolving
+a batch does not touch the heap. For a batch of n <= maxPaths paths the
+arrays are used with the layout of PathKernel::evolve() for nPaths = n.
+*/
+struct PathArena {
+	PathArena() {}
+	// dimension: draws per path (0 if the paths are not evolved by a
+	// kernel); nPoints: grid points per path, the initial one included
+	PathArena(Size dimension, Size nPoints, Size maxPaths)
+		: normals(dimension * maxPaths), spots(nPoints * maxPaths), workspace(maxPaths) {}
+
+	// the next n draws of the generator, one path each, laid out
+	// time-major: the d-th draw of path p goes to normals[d*n + p]
+	template <class RSG>
+	void draw(RSG& generator, Size n) {
+		for (Size p = 0; p < n; p++) {
+			const std::vector<Real>& z = generator.nextSequence().value;
+			for (Size d = 0; d < z.size(); d++)
+				normals[d*n + p] = z[d];
+		}
+	}
+
+	std::vector<Real> normals;
+	std::vector<Real> spots;
+	std::vector<Real> workspace;
+};
+
+#endif // !path_kernel_hpp
@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <ql/quantlib.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <pricehistory.hpp>
+#include <csvrecords.hpp>
+
+using namespace QuantLib;
+
+namespace {
+
+	const char historyMagic[8] = { 'M', 'I', 'P', 'T', 'I', 'C', 'K', '\0' };
+	const boost::uint32_t historyVersion = 1;
+
+	// 32 bytes: the prices after it stay aligned
+	struct HistoryHeader {
+		char magic[8];
+		boost::uint32_t version;
+		boost::uint32_t reserved;
+		Real ticksPerYear;
+		boost::uint64_t size;
+	};
+
+}
+
+
+PriceHistory::PriceHistory(const std::string& fileName) {
+
+	using namespace boost::interprocess;
+	file_mapping file(fileName.c_str(), read_only);
+	region_ = boost::shared_ptr<mapped_region>(new mapped_region(file, read_only));
+	const char* data = static_cast<const char*>(region_->get_address());
+	std::size_t size = region_->get_size();
+
+	HistoryHeader header;
+	QL_REQUIRE(size >= sizeof(header), fileName << " is not a price history");
+	std::memcpy(&header, data, sizeof(header));
+	QL_REQUIRE(std::memcmp(header.magic, historyMagic, sizeof(historyMagic)) == 0,
+		fileName << " is not a price history");
+	QL_REQUIRE(header.version == historyVersion,
+		fileName << " has format version " << header.version << ", " << historyVersion << " expected");
+	QL_REQUIRE(size == sizeof(header) + header.size * sizeof(Real),
+		fileName << " is truncated");
+	QL_REQUIRE(header.size > 1, fileName << " holds less than two prices");
+	QL_REQUIRE(header.ticksPerYear > 0.0, fileName << ": the ticks per year must be positive");
+
+	// the mapping is page aligned: the prices are read in place
+	prices_ = reinterpret_cast<const Real*>(data + sizeof(header));
+	size_ = Size(header.size);
+	ticksPerYear_ = header.ticksPerYear;
+}
+
+
+Size PriceHistory::importPrices(const std::string& textFileName,
+	const std::string& fileName, Real ticksPerYear) {
+
+	QL_REQUIRE(ticksPerYear > 0.0, "the ticks per year must be positive");
+	std::ifstream in(textFileName.c_str());
+	QL_REQUIRE(in, "cannot open the price file " << textFileName);
+
+	HistoryHeader header;
+	std::memcpy(header.magic, historyMagic, sizeof(historyMagic));
+	header.version = historyVersion;
+	header.reserved = 0;
+	header.ticksPerYear = ticksPerYear;
+	header.size = 0;
+
+	// written aside and then renamed, as the market snapshots; the header
+	// is written again at the end, with the number of ticks
+	std::string partialName = fileName + ".partial";
+	try {
+		std::ofstream file(partialName.c_str(), std::ios::binary | std::ios::trunc);
+		QL_REQUIRE(file, "cannot write the price history " << partialName);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		// the prices go out a block at a time
+		std::vector<Real> block;
+		block.reserve(4096);
+		auto flush = [&]() {
+			if (!block.empty())
+				file.write(reinterpret_cast<const char*>(&block[0]), block.size() * sizeof(Real));
+			block.clear();
+		};
+
+		std::vector<std::string> fields;
+		Size line = 0;
+		while (readRecord(in, fields, line)) {
+			try {
+				Real price = parseReal(fields.back(), "price");
+				QL_REQUIRE(price > 0.0, "the prices must be positive");
+				block.push_back(price);
+			}
+			catch (std::exception& e) {
+				QL_FAIL(textFileName << ", line " << line << ": " << e.what());
+			}
+			header.size++;
+			if (block.size() == block.capacity())
+				flush();
+		}
+		flush();
+
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.close();
+		QL_REQUIRE(file, "cannot write the price history " << partialName);
+		QL_REQUIRE(header.size > 1, textFileName << " holds less than two prices");
+	}
+	catch (...) {
+		// no partial file is left behind
+		std::remove(partialName.c_str());
+		throw;
+	}
+
+	std::remove(fileName.c_str());
+	QL_REQUIRE(std::rename(partialName.c_str(), fileName.c_str()) == 0,
+		"cannot rename " << partialName << " to " << fileName);
+	return Size(header.size);
+}
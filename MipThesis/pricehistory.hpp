@@ -0,0 +1,47 @@
+#pragma once
+
+#ifndef price_history_hpp
+#define price_history_hpp
+
+#include <ql/quantlib.hpp>
+#include <string>
+
+namespace boost { namespace interprocess { class mapped_region; } }
+
+using namespace QuantLib;
+
+/* A historical price series, evenly spaced in time, mapped from a binary
+file: a short header (format version, ticks per year, number of ticks)
+followed by the prices as 8-byte reals. The prices are read in place,
+so that series of millions of ticks are neither loaded nor copied.
+
+The binary files are written by importPrices() from text files with one
+price per record, as the last field of the line (e.g. "timestamp,price");
+blank lines and lines starting with '#' are skipped. The prices are
+checked to be positive when imported, not when mapped.
+*/
+
+class PriceHistory {
+	public:
+		explicit PriceHistory(const std::string& fileName);
+
+		Size size() const { return size_; }
+		Real ticksPerYear() const { return ticksPerYear_; }
+		const Real* begin() const { return prices_; }
+		const Real* end() const { return prices_ + size_; }
+		Real operator[](Size i) const { return prices_[i]; }
+
+		// converts a text file to a binary one, streaming it, and returns
+		// the number of ticks written
+		static Size importPrices(const std::string& textFileName,
+			const std::string& fileName, Real ticksPerYear);
+
+	private:
+		// the mapping, shared by the copies
+		boost::shared_ptr<boost::interprocess::mapped_region> region_;
+		const Real* prices_;
+		Size size_;
+		Real ticksPerYear_;
+};
+
+#endif // !price_history_hpp
@@ -0,0 +1,162 @@
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <ql/quantlib.hpp>
+#include <replicationbacktest.hpp>
+#include <marketdata.hpp>
+#include <incrementaldiscountcurve.hpp>
+#include <parallelmontecarlo.hpp>
+
+using namespace QuantLib;
+
+ReplicationBacktest::ReplicationBacktest(const std::vector<MarketQuotes>& history,
+										 Option::Type type,
+										 Date expiryDate,
+										 Real strike,
+										 Natural fixingDays,
+										 Calendar calendar)
+	: history_(history), type_(type), expiryDate_(expiryDate), strike_(strike),
+	fixingDays_(fixingDays), calendar_(calendar) {
+	QL_REQUIRE(!history_.empty(), "no valuation dates given");
+	QL_REQUIRE(strike_ > 0.0, "the strike must be positive");
+}
+
+// The market of each valuation date, moved from the previous one
+std::vector<ReplicationBacktest::FrozenMarket> ReplicationBacktest::freeze() const {
+
+	// the evaluation date is restored on the way out
+	SavedSettings backup;
+
+	DayCounter dayCount = Actual365Fixed();
+	std::vector<FrozenMarket> markets;
+	markets.reserve(history_.size());
+
+	std::vector<boost::shared_ptr<SimpleQuote> > OISQuotes;
+	std::vector<Period> OISTenors;
+	boost::shared_ptr<IncrementalDiscountCurve> OISTermStructure;
+
+	for (Size d = 0; d < history_.size(); d++) {
+		const MarketQuotes& market = history_[d];
+
+		Settings::instance().evaluationDate() = market.valuationDate;
+		Date settlementDate = calendar_.advance(market.valuationDate, fixingDays_, Days);
+		// the valuation dates increase: none of the following ones settles in time
+		if (settlementDate >= expiryDate_)
+			break;
+
+		// the curve follows the evaluation date and only its quotes are
+		// moved; it is built again when the swaps quoted change
+		if (OISTermStructure && market.OISTenors == OISTenors) {
+			for (Size i = 0; i < OISQuotes.size(); i++)
+				OISQuotes[i]->setValue(market.OISRates[i]);
+		}
+		else {
+			OISTermStructure = boost::dynamic_pointer_cast<IncrementalDiscountCurve>(
+				MarketData::buildmovingdiscountingcurve(market, fixingDays_, calendar_, &OISQuotes));
+			OISTenors = market.OISTenors;
+		}
+
+		FrozenMarket frozen;
+		frozen.valuationDate = market.valuationDate;
+		frozen.spot = market.spot;
+		frozen.maturity = dayCount.yearFraction(settlementDate, expiryDate_);
+		frozen.volatility = MarketData::buildblackvariancesurface(market, settlementDate, calendar_)
+			->blackVol(expiryDate_, strike_);
+		try {
+			frozen.curveDates = OISTermStructure->dates();
+			frozen.curveDiscounts = OISTermStructure->discounts();
+		}
+		catch (std::exception& e) {
+			QL_FAIL("OIS curve of " << market.valuationDate << ": " << e.what());
+		}
+		markets.push_back(frozen);
+	}
+	return markets;
+}
+
+void ReplicationBacktest::run(const std::vector<Size>& hedgesNums, Size nSamples,
+							  const std::string& fileName,
+							  const ReplicationSettings& settings) const
+{
+	QL_REQUIRE(!hedgesNums.empty(), "no hedging frequency given");
+
+	std::ofstream out(fileName.c_str());
+	QL_REQUIRE(out, "cannot write the backtest file " << fileName);
+
+	std::vector<FrozenMarket> markets = freeze();
+	QL_REQUIRE(!markets.empty(), "no valuation date settles before the expiry " << expiryDate_);
+	Size nDates = markets.size();
+
+	Size nThreads = settings.nThreads > 0 ? settings.nThreads : defaultThreads();
+	nThreads = std::min(nThreads, nDates);
+	BigNatural masterSeed = settings.seed != 0 ? settings.seed : SeedGenerator::instance().get();
+
+	std::cout << "Backtest over " << nDates << " valuation dates, from "
+		<< io::iso_date(markets.front().valuationDate) << " to " << io::iso_date(markets.back().valuationDate)
+		<< ", " << nSamples << " paths per date on " << nThreads << " threads" << std::endl;
+
+	out << "date,spot,volatility,maturity,trades,samples,mean,stddev,dermankamal,skewness,kurtosis\n";
+	out.flush();
+
+	// the lines of the dates done ahead of an earlier one wait here
+	std::vector<std::string> lines(nDates);
+	std::vector<bool> done(nDates, false);
+	Size nextDate = 0;
+	std::mutex writer;
+
+	// The objects of every date are built here, and destroyed on return:
+	// the processes register with the global evaluation date, which is not
+	// thread-safe. Each date is then simulated by a single worker, which
+	// only runs its paths.
+	std::vector<boost::shared_ptr<ReplicationError> > replications;
+	std::vector<boost::shared_ptr<ReplicationError::Simulation> > simulations;
+	for (Size d = 0; d < nDates; d++) {
+		const FrozenMarket& market = markets[d];
+		boost::shared_ptr<YieldTermStructure> OISTermStructure(
+			new InterpolatedDiscountCurve<LogLinear>(market.curveDates, market.curveDiscounts,
+				ActualActual(ActualActual::ISDA)));
+		OISTermStructure->enableExtrapolation();
+		boost::shared_ptr<Quote> underlying(new SimpleQuote(market.spot));
+		replications.push_back(boost::shared_ptr<ReplicationError>(new ReplicationError(type_,
+			market.maturity, strike_, underlying, market.volatility, OISTermStructure, false)));
+
+		ReplicationSettings dateSettings = settings;
+		dateSettings.nThreads = 1;
+		dateSettings.seed = streamSeed(masterSeed, d);
+		simulations.push_back(replications.back()->prepare(hedgesNums, nSamples, dateSettings));
+	}
+
+	runBatches(nDates, nThreads, [&](Size d, Size) {
+		const FrozenMarket& market = markets[d];
+		const ReplicationError& replication = *replications[d];
+		std::vector<Statistics> statistics = replication.distributions(*simulations[d], nSamples);
+
+		std::ostringstream line;
+		line.precision(10);
+		for (Size f = 0; f < hedgesNums.size(); f++)
+			line << io::iso_date(market.valuationDate) << ","
+				<< market.spot << ","
+				<< market.volatility << ","
+				<< market.maturity << ","
+				<< hedgesNums[f] << ","
+				<< nSamples << ","
+				<< statistics[f].mean() << ","
+				<< statistics[f].standardDeviation() << ","
+				<< replication.dermanKamalStdDev(hedgesNums[f]) << ","
+				<< statistics[f].skewness() << ","
+				<< statistics[f].kurtosis() << "\n";
+
+		std::lock_guard<std::mutex> lock(writer);
+		lines[d] = line.str();
+		done[d] = true;
+		for (; nextDate < nDates && done[nextDate]; nextDate++) {
+			out << lines[nextDate];
+			std::string().swap(lines[nextDate]);
+		}
+		out.flush();
+	});
+
+	QL_ENSURE(out, "error writing the backtest file " << fileName);
+	std::cout << "results written to " << fileName << std::endl;
+}
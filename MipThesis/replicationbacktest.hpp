@@ -0,0 +1,74 @@
+#pragma once
+
+#ifndef replication_backtest_hpp
+#define replication_backtest_hpp
+
+#include <ql/quantlib.hpp>
+#include <marketquotes.hpp>
+#include <replicationerror.hpp>
+#include <string>
+
+using namespace QuantLib;
+
+/* Historical backtest of the Derman and Kamal replication study: the
+option of a fixed expiry and strike is hedged from each valuation date of
+a market history, on that date's OIS curve, spot and Black volatility at
+the expiry and strike, and the P&L distribution of each number of hedges
+is priced by ReplicationError.
+
+The market is moved from date to date rather than built again: the
+evaluation date is set, the OIS quotes of the curve, which follows the
+evaluation date, are updated and the curve re-solves on its previous
+nodes. QuantLib's evaluation date and observers are global and not
+thread-safe, so this runs on the calling thread, and each date's market is
+frozen into plain values (spot, volatility, time to expiry, curve nodes).
+The objects of every date (curve, process, generator and pricer) are then
+built on the frozen values, still on the calling thread, and the dates are
+spread across the workers, which only run their paths, with the seed
+streamSeed(seed, date index): the results do not depend on the number of
+threads.
+
+The results are written to a CSV file, one line per date and number of
+hedges, as soon as the dates before them are done:
+
+	date,spot,volatility,maturity,trades,samples,mean,stddev,dermankamal,skewness,kurtosis
+*/
+
+class ReplicationBacktest {
+	public:
+		// the dates with a settlement on or after the expiry are skipped
+		ReplicationBacktest(const std::vector<MarketQuotes>& history,
+			Option::Type type,
+			Date expiryDate,
+			Real strike,
+			Natural fixingDays,
+			Calendar calendar);
+
+		// settings.nThreads spreads the dates, each one being simulated
+		// by a single worker; the other settings apply to every date
+		void run(const std::vector<Size>& hedgesNums, Size nSamples,
+			const std::string& fileName,
+			const ReplicationSettings& settings = ReplicationSettings()) const;
+
+	private:
+		// the market of a valuation date, as read by the simulation
+		struct FrozenMarket {
+			Date valuationDate;
+			Real spot;
+			Volatility volatility;
+			Time maturity;
+			std::vector<Date> curveDates;
+			std::vector<DiscountFactor> curveDiscounts;
+		};
+
+		std::vector<FrozenMarket> freeze() const;
+
+		std::vector<MarketQuotes> history_;
+		Option::Type type_;
+		Date expiryDate_;
+		Real strike_;
+		Natural fixingDays_;
+		Calendar calendar_;
+};
+
+#endif // !replication_backtest_hpp
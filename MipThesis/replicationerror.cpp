@@ -1,8 +1,16 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <ql/quantlib.hpp>
 #include <replicationerror.hpp>
 #include <replicationpathpricer.hpp>
 #include <marketdata.hpp>
+#include <parallelmontecarlo.hpp>
+#include <pathkernel.hpp>
+#include <allocationcounter.hpp>
+#include <sobolbridge.hpp>
+#include <aad.hpp>
+#include <sensitivities.hpp>
 
 using namespace QuantLib;
 
@@ -12,7 +20,8 @@ ReplicationError::ReplicationError(Option::Type type,
 								   boost::shared_ptr<Quote> s0,
 								   //boost::shared_ptr<BlackVarianceSurface> varTS,
 								   Volatility vol,
-								   boost::shared_ptr<YieldTermStructure> OISTermStructure)
+								   boost::shared_ptr<YieldTermStructure> OISTermStructure,
+								   bool verbose)
 	: maturity_(maturity), payoff_(type, strike), strike_(strike), s0_(s0), sigma_(vol), OISTermStructure_(OISTermStructure) {
 
 	// value of the option
@@ -25,11 +34,15 @@ ReplicationError::ReplicationError(Option::Type type,
 	Real stdDev = std::sqrt(sigma_*sigma_*maturity_);
 	boost::shared_ptr<StrikedTypePayoff> payoff(new PlainVanillaPayoff(payoff_));
 	BlackCalculator black(payoff, forward, stdDev, rDiscount);
-	std::cout << "Option value: " << black.value() << std::endl;
 	
 	// store option's vega, since Derman and Kamal's formula needs it
 	vega_ = black.vega(maturity_);
 
+	// the value and the header of the table the computations print
+	if (!verbose)
+		return;
+
+	std::cout << "Option value: " << black.value() << std::endl;
 	std::cout << std::endl;
 
 	std::cout << std::setw(8) << " " << " | "
@@ -53,73 +66,549 @@ ReplicationError::ReplicationError(Option::Type type,
 }
 
 
+// Paths simulated by the i-th of nThreads workers:
+// the first nSamples % nThreads workers take one path more
+static Size workerSamples(Size nSamples, Size nThreads, Size i) {
+	return nSamples / nThreads + (i < nSamples % nThreads ? 1 : 0);
+}
+
 // The computation over nSamples paths of the P&L distribution
-void ReplicationError::compute(Size nTimeSteps, Size nSamples)
+void ReplicationError::compute(Size nTimeSteps, Size nSamples, const ReplicationSettings& settings)
+{
+	std::vector<Real> meanErrors;
+	std::vector<Statistics> statistics =
+		simulate(std::vector<Size>(1, nTimeSteps), nSamples, settings, meanErrors);
+	printRow(nSamples, nTimeSteps, statistics[0]);
+	printMeanErrors(std::vector<Size>(1, nTimeSteps), settings, meanErrors);
+}
+
+// The same computation for several hedging frequencies. Every path is
+// simulated once and hedged at each frequency, so that the rows of the
+// table share their random numbers.
+void ReplicationError::sweep(const std::vector<Size>& hedgesNums, Size nSamples,
+							 const ReplicationSettings& settings)
+{
+	std::vector<Real> meanErrors;
+	std::vector<Statistics> statistics = simulate(hedgesNums, nSamples, settings, meanErrors);
+	for (Size f = 0; f < hedgesNums.size(); f++)
+		printRow(nSamples, hedgesNums[f], statistics[f]);
+	printMeanErrors(hedgesNums, settings, meanErrors);
+}
+
+// The distributions of sweep(), for callers printing or storing them
+// their own way
+std::vector<Statistics> ReplicationError::distributions(const std::vector<Size>& hedgesNums,
+														Size nSamples,
+														const ReplicationSettings& settings)
+{
+	std::vector<Real> meanErrors;
+	return simulate(hedgesNums, nSamples, settings, meanErrors);
+}
+
+std::vector<Statistics> ReplicationError::distributions(Simulation& simulation,
+														Size nSamples) const
+{
+	std::vector<Real> meanErrors;
+	return run(simulation, nSamples, meanErrors);
+}
+
+// The same computation, one batch of paths at a time. The simulation is
+// prepared once, for batches of batchSize paths, and each batch is a run
+// of it: the workers' generators go on drawing from their streams, so the
+// run only depends on the seed, the batch size and the number of threads.
+void ReplicationError::computeToTolerance(Real absErr, Size maxSamples, Size batchSize, Size nTimeSteps,
+										  const ReplicationSettings& settings)
+{
+	QL_REQUIRE(absErr > 0.0, "the error tolerance must be positive");
+	QL_REQUIRE(batchSize > 1, "the batch size must be > 1");
+	QL_REQUIRE(maxSamples >= batchSize, "the maximum samples must be at least a batch");
+	QL_REQUIRE(!settings.quasiRandom,
+		"the standard error of the tolerance mode needs pseudo-random draws");
+
+	ReplicationSettings batchSettings = settings;
+	if (batchSettings.seed == 0)
+		batchSettings.seed = SeedGenerator::instance().get();
+	boost::shared_ptr<Simulation> simulation =
+		prepare(std::vector<Size>(1, nTimeSteps), batchSize, batchSettings);
+
+	Statistics statisticsAccumulator;
+	std::vector<Real> meanErrors;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (statisticsAccumulator.samples() < maxSamples) {
+		Size n = std::min(batchSize, maxSamples - statisticsAccumulator.samples());
+		std::vector<Statistics> statistics = run(*simulation, n, meanErrors);
+		mergeStatistics(statisticsAccumulator, statistics[0]);
+
+		Real error = statisticsAccumulator.errorEstimate();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		printConvergence(statisticsAccumulator.samples(), statisticsAccumulator.mean(),
+			error, elapsed.count());
+		if (error < absErr)
+			break;
+	}
+	printRow(statisticsAccumulator.samples(), nTimeSteps, statisticsAccumulator);
+}
+
+// Adjoint sensitivities of the mean P&L. The inputs of the tape are the
+// spot, the discount factors at the hedge times and at maturity and the
+// volatilities of the surface nodes; the volatility of the option is
+// interpolated from the nodes on the tape, and each path is hedged by
+// ReplicationPathPricer::hedge() on Numbers. Each path is recorded, swept
+// back to the checkpoint left after the inputs and dropped, so the tape
+// never holds more than one path.
+void ReplicationError::computeSensitivities(Size nTimeSteps, Size nSamples,
+											const std::vector<boost::shared_ptr<SimpleQuote> >& OISQuotes,
+											const FlatBlackVarianceSurface& volatilitySurface,
+											const ReplicationSettings& settings)
+{
+	QL_REQUIRE(nSamples > 0, "the number of samples must be > 0");
+
+	Size nThreads = settings.nThreads == 0 ? defaultThreads() : settings.nThreads;
+	nThreads = std::min(nThreads, nSamples);
+	BigNatural masterSeed = settings.seed;
+	if (nThreads > 1 && masterSeed == 0)
+		masterSeed = SeedGenerator::instance().get();
+
+	HedgingSchedule schedule(OISTermStructure_, maturity_, sigma_, nTimeSteps);
+	std::vector<Time> times(schedule.hedgeTimes);
+	times.push_back(maturity_);
+	auto discounts = [&]() {
+		std::vector<Real> values(times.size());
+		for (Size k = 0; k < times.size(); k++)
+			values[k] = OISTermStructure_->discount(times[k]);
+		return values;
+	};
+
+	// spot, discount factors, node volatilities
+	std::vector<Real> inputs(1, s0_->value());
+	std::vector<Real> curveDiscounts = discounts();
+	inputs.insert(inputs.end(), curveDiscounts.begin(), curveDiscounts.end());
+	Size firstNode = inputs.size();
+	std::vector<Volatility> nodeVolatilities = volatilitySurface.nodeVolatilities();
+	inputs.insert(inputs.end(), nodeVolatilities.begin(), nodeVolatilities.end());
+
+	Volatility surfaceVolatility = std::sqrt(
+		volatilitySurface.interpolatedVariance(maturity_, strike_, &nodeVolatilities[0]) / maturity_);
+	QL_REQUIRE(std::fabs(surfaceVolatility - sigma_) < 1.0e-10,
+		"the surface gives a volatility of " << surfaceVolatility << " at the expiry and strike, "
+		<< sigma_ << " simulated");
+
+	// the generators and the pricer are built here, the workers only draw
+	// from the former and read the latter
+	std::vector<PseudoRandom::rsg_type> generators;
+	for (Size i = 0; i < nThreads; i++) {
+		BigNatural seed = nThreads == 1 ? masterSeed : streamSeed(masterSeed, i);
+		generators.push_back(PseudoRandom::make_sequence_generator(nTimeSteps, seed));
+	}
+	ReplicationPathPricer pricer(payoff_.optionType(), strike_, maturity_);
+
+	std::vector<std::vector<Real> > workerAdjoints(nThreads);
+	std::vector<Real> workerVolatilityAdjoints(nThreads);
+	std::vector<Real> workerSums(nThreads, 0.0);
+	std::vector<Size> tapeSizes(nThreads, 0);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	runOnThreads(nThreads, [&](Size i) {
+		Tape tape;
+		ActiveTape activeTape(tape);
+
+		std::vector<Number> variables;
+		for (Size j = 0; j < inputs.size(); j++)
+			variables.push_back(Number::variable(inputs[j]));
+		const Number& s0 = variables[0];
+		const Number* D = &variables[1];
+		Number sigma = sqrt(volatilitySurface.interpolatedVariance(maturity_, strike_,
+			&variables[firstNode]) / maturity_);
+
+		// the schedule on the tape, shared by all the paths
+		std::vector<Number> accruals, growths, shocks, rDiscounts, stdDevs;
+		for (Size k = 0; k < nTimeSteps; k++) {
+			Time dt = times[k + 1] - times[k];
+			accruals.push_back(D[k] / D[k + 1]);
+			shocks.push_back(sigma * std::sqrt(dt));
+			growths.push_back(accruals[k] * exp(-0.5 * shocks[k] * shocks[k]));
+			rDiscounts.push_back(D[nTimeSteps] / D[k]);
+			stdDevs.push_back(sigma * std::sqrt(maturity_ - times[k]));
+		}
+		tape.mark();
+
+		std::vector<Number> path(nTimeSteps + 1);
+		Real sum = 0.0;
+		for (Size p = workerSamples(nSamples, nThreads, i); p > 0; p--) {
+			const std::vector<Real>& z = generators[i].nextSequence().value;
+
+			// the path on the tape, hedged by the pricer
+			path[0] = s0;
+			for (Size step = 1; step <= nTimeSteps; step++)
+				path[step] = path[step - 1] * (growths[step - 1] * exp(shocks[step - 1] * z[step - 1]));
+			Number PL = pricer.hedge(&path[0], 1, nTimeSteps, &accruals[0], &rDiscounts[0], &stdDevs[0]);
+
+			sum += PL.value();
+			tapeSizes[i] = std::max(tapeSizes[i], tape.size());
+			tape.adjoint(PL.index()) += 1.0;
+			tape.propagateToMark();
+			tape.rewindToMark();
+		}
+		tape.propagateToStart();
+
+		workerSums[i] = sum;
+		workerVolatilityAdjoints[i] = tape.adjoint(sigma.index());
+		for (Size j = 0; j < variables.size(); j++)
+			workerAdjoints[i].push_back(tape.adjoint(variables[j].index()));
+	});
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	// the worker sums are added in worker order
+	Real mean = 0.0, volatilityAdjoint = 0.0;
+	std::vector<Real> gradient(inputs.size(), 0.0);
+	for (Size i = 0; i < nThreads; i++) {
+		mean += workerSums[i] / nSamples;
+		volatilityAdjoint += workerVolatilityAdjoints[i] / nSamples;
+		for (Size j = 0; j < inputs.size(); j++)
+			gradient[j] += workerAdjoints[i][j] / nSamples;
+	}
+	std::vector<Real> discountAdjoints(gradient.begin() + 1, gradient.begin() + firstNode);
+	std::vector<Real> nodeSensitivities(gradient.begin() + firstNode, gradient.end());
+
+	std::cout << std::endl << "Adjoint sensitivities of the P&L mean, "
+		<< nTimeSteps << " hedges, " << nSamples << " paths" << std::endl;
+	std::cout << std::fixed << std::setprecision(6)
+		<< "  P&L mean   " << std::setw(12) << mean << std::endl
+		<< "  dP&L/dS0   " << std::setw(12) << gradient[0] << std::endl
+		<< "  dP&L/dvol  " << std::setw(12) << volatilityAdjoint << std::endl
+		<< "  tape nodes per path " << *std::max_element(tapeSizes.begin(), tapeSizes.end())
+		<< ", " << std::setprecision(2) << elapsed.count() << " s" << std::endl;
+
+	std::cout << "per basis point of the OIS quotes:" << std::endl;
+	printSensitivities("OIS quote", chainRule(quoteJacobian(OISQuotes, discounts, 1.0e-5),
+		discountAdjoints), 1.0e-4);
+
+	std::cout << "per volatility point of the surface nodes:" << std::endl;
+	printSensitivities("vol node", nodeSensitivities, 0.01);
+}
+
+// The objects of a simulation, built by prepare() on the calling thread
+// and then read by the workers of each run()
+struct ReplicationError::Simulation {
+	typedef SingleVariate<PseudoRandom>::path_generator_type generator_type;
+
+	std::vector<Size> hedgesNums;
+	ReplicationSettings settings;
+	TimeGrid grid;
+	// the hedging schedule of each frequency, and the grid points its
+	// hedges (and the expiry) fall on
+	std::vector<HedgingSchedule> schedules;
+	std::vector<std::vector<Size> > hedgeIndices;
+	std::vector<bool> wholeGrid;
+	Size nThreads;
+	BigNatural masterSeed;
+	// the objects of each worker
+	std::vector<boost::shared_ptr<generator_type> > pathGenerators;
+	std::vector<boost::shared_ptr<ReplicationPathPricer> > pathPricers;
+	std::vector<boost::shared_ptr<PathKernel> > pathKernels;
+	std::vector<PseudoRandom::rsg_type> sequenceGenerators;
+};
+
+// The simulation behind compute() and sweep(): the paths are generated on
+// the union of the hedge times of all the frequencies, and the hedges of
+// each frequency read the spots at their own times from the same path.
+std::vector<Statistics> ReplicationError::simulate(const std::vector<Size>& hedgesNums,
+												   Size nSamples,
+												   const ReplicationSettings& settings,
+												   std::vector<Real>& meanErrors)
 {
-	QL_REQUIRE(nTimeSteps>0, "the number of steps must be > 0");
+	boost::shared_ptr<Simulation> simulation = prepare(hedgesNums, nSamples, settings);
+	return run(*simulation, nSamples, meanErrors);
+}
+
+// The grid, the schedules and the objects of each worker, for runs of up
+// to nSamples paths. The workers' generators draw from their streams run
+// after run.
+boost::shared_ptr<ReplicationError::Simulation> ReplicationError::prepare(const std::vector<Size>& hedgesNums,
+																		  Size nSamples,
+																		  const ReplicationSettings& settings) const
+{
+	QL_REQUIRE(!hedgesNums.empty(), "no hedging frequency given");
+	QL_REQUIRE(nSamples>0, "the number of samples must be > 0");
+	QL_REQUIRE(!settings.pathKernel || settings.batchSize > 0,
+		"the vectorised path kernel needs a batch size > 0");
+	QL_REQUIRE(!settings.quasiRandom || settings.pathKernel,
+		"the quasi-random draws need the vectorised path kernel");
+
+	boost::shared_ptr<Simulation> simulation(new Simulation);
+	simulation->hedgesNums = hedgesNums;
+	simulation->settings = settings;
+	Size nFrequencies = hedgesNums.size();
 
 	// hedging interval
 	// Time tau = maturity_ / nTimeSteps;
 
+	// the simulation grid holds the hedge times of every frequency,
+	// computed as in HedgingSchedule so that they can be found back
+	std::vector<Time> times;
+	for (Size f = 0; f < nFrequencies; f++) {
+		Size n = hedgesNums[f];
+		QL_REQUIRE(n>0, "the number of steps must be > 0");
+		Time dt = maturity_ / n;
+		for (Size k = 0; k < n; k++)
+			times.push_back(k * dt);
+		times.push_back(maturity_);
+	}
+	std::sort(times.begin(), times.end());
+	std::vector<Time> gridTimes(1, times[0]);
+	for (Size j = 1; j < times.size(); j++)
+		if (!close_enough(times[j], gridTimes.back()))
+			gridTimes.push_back(times[j]);
+	TimeGrid grid(gridTimes.begin(), gridTimes.end());
+	Size nGridSteps = grid.size() - 1;
+	simulation->grid = grid;
+
+	// a frequency spanning the whole grid reads the paths as they are
+	simulation->hedgeIndices.resize(nFrequencies);
+	for (Size f = 0; f < nFrequencies; f++) {
+		Size n = hedgesNums[f];
+		simulation->schedules.push_back(HedgingSchedule(OISTermStructure_, maturity_, sigma_, n));
+		Time dt = maturity_ / n;
+		for (Size k = 0; k < n; k++)
+			simulation->hedgeIndices[f].push_back(grid.index(k * dt));
+		simulation->hedgeIndices[f].push_back(grid.index(maturity_));
+		simulation->wholeGrid.push_back(n == nGridSteps);
+	}
+
 	Calendar calendar = TARGET();
 	DayCounter dayCount = Actual365Fixed();
-	Date settlementDate(04, April, 2017);
+	// the volatility starts from the reference date of the curve
+	Date settlementDate = OISTermStructure_->referenceDate();
 
-	const boost::shared_ptr<BlackVolTermStructure> volatility(new BlackConstantVol(settlementDate, calendar, sigma_, dayCount));
-	
-	boost::shared_ptr<StochasticProcess1D> diffusion(new BlackScholesProcess(Handle<Quote>(s0_),
-		Handle<YieldTermStructure>(OISTermStructure_),
-		Handle<BlackVolTermStructure>(volatility)));
+	// the samples are split evenly across the workers;
+	// a single worker runs the original serial simulation
+	Size nThreads = settings.nThreads > 0 ? settings.nThreads : defaultThreads();
+	nThreads = std::min(nThreads, nSamples);
+	simulation->nThreads = nThreads;
 
-	// Black Scholes equation rules the path generator:
-	// at each step the log of the stock
-	// will have drift and sigma^2 variance
+	BigNatural masterSeed = settings.seed;
+	if (nThreads > 1 && masterSeed == 0)
+		masterSeed = SeedGenerator::instance().get();
+	simulation->masterSeed = masterSeed;
 
-	PseudoRandom::rsg_type rsg =
-		PseudoRandom::make_sequence_generator(nTimeSteps, 0);
+	// Each worker gets its own process, path generator and path pricer.
+	// They are all built here, before the threads start, since they
+	// register themselves with the shared term structures.
+	for (Size i = 0; i < nThreads; i++) {
 
-	bool brownianBridge = false;
+		const boost::shared_ptr<BlackVolTermStructure> volatility(new BlackConstantVol(settlementDate, calendar, sigma_, dayCount));
 
-	typedef SingleVariate<PseudoRandom>::path_generator_type generator_type;
-	boost::shared_ptr<generator_type> myPathGenerator(new
-		generator_type(diffusion, maturity_, nTimeSteps,
-			rsg, brownianBridge));
+		boost::shared_ptr<StochasticProcess1D> diffusion(new BlackScholesProcess(Handle<Quote>(s0_),
+			Handle<YieldTermStructure>(OISTermStructure_),
+			Handle<BlackVolTermStructure>(volatility)));
 
-	// The replication strategy's Profit&Loss is computed for each path
-	// of the stock. The path pricer knows how to price a path using its
-	// value() method
+		// the local volatility is set up lazily at the first evolve() call:
+		// force it here rather than inside the worker
+		diffusion->diffusion(0.0, diffusion->x0());
 
-	//auto pricersigma = MarketData::buildblackvariancesurface(settlementDate, TARGET());  // Please fix me
+		// Black Scholes equation rules the path generator:
+		// at each step the log of the stock
+		// will have drift and sigma^2 variance
 
-	boost::shared_ptr<PathPricer<Path>> myPathPricer(
-		new ReplicationPathPricer(payoff_.optionType(), strike_, OISTermStructure_, maturity_, //pricersigma));
-			sigma_));
+		// every worker draws from an independent stream of the master seed
+		BigNatural seed = nThreads == 1 ? masterSeed : streamSeed(masterSeed, i);
+		PseudoRandom::rsg_type rsg =
+			PseudoRandom::make_sequence_generator(nGridSteps, seed);
 
-	// a statistics accumulator for the path-dependant Profit&Loss values
-	Statistics statisticsAccumulator;
+		bool brownianBridge = false;
+
+		boost::shared_ptr<Simulation::generator_type> myPathGenerator(new
+			Simulation::generator_type(diffusion, grid, rsg, brownianBridge));
+
+		// The replication strategy's Profit&Loss is computed for each path
+		// of the stock. The path pricer hedges it at every frequency, each
+		// one with its own schedule
+
+		//auto pricersigma = MarketData::buildblackvariancesurface(settlementDate, TARGET());  // Please fix me
+
+		boost::shared_ptr<ReplicationPathPricer> myPathPricer(
+			new ReplicationPathPricer(payoff_.optionType(), strike_, maturity_, settings.deltaMethod));
+
+		simulation->pathGenerators.push_back(myPathGenerator);
+		simulation->pathPricers.push_back(myPathPricer);
+
+		// the vectorised kernel evolves the batches from the same draws
+		simulation->sequenceGenerators.push_back(rsg);
+		if (settings.pathKernel)
+			simulation->pathKernels.push_back(boost::shared_ptr<PathKernel>(
+				new PathKernel(diffusion, grid)));
+	}
+	return simulation;
+}
 
-	// The Monte Carlo model generates paths using myPathGenerator
-	// each path is priced using myPathPricer
-	// prices will be accumulated into statisticsAccumulator
-	MonteCarloModel<SingleVariate, PseudoRandom>
-		MCSimulation(myPathGenerator,
-			myPathPricer,
-			statisticsAccumulator,
-			false);
-
-	// the model simulates nSamples paths
-	MCSimulation.addSamples(nSamples);
-
-	// the sampleAccumulator method
-	// gives access to all the methods of statisticsAccumulator
-	Real PLMean = MCSimulation.sampleAccumulator().mean();
-	Real PLStDev = MCSimulation.sampleAccumulator().standardDeviation();
-	Real PLSkew = MCSimulation.sampleAccumulator().skewness();
-	Real PLKurt = MCSimulation.sampleAccumulator().kurtosis();
+// nSamples more paths of a prepared simulation, hedged at each of its
+// frequencies
+std::vector<Statistics> ReplicationError::run(Simulation& simulation, Size nSamples,
+											  std::vector<Real>& meanErrors) const
+{
+	QL_REQUIRE(nSamples>0, "the number of samples must be > 0");
+
+	const ReplicationSettings& settings = simulation.settings;
+	const TimeGrid& grid = simulation.grid;
+	const std::vector<HedgingSchedule>& schedules = simulation.schedules;
+	const std::vector<std::vector<Size> >& hedgeIndices = simulation.hedgeIndices;
+	const std::vector<bool>& wholeGrid = simulation.wholeGrid;
+	Size nFrequencies = simulation.hedgesNums.size();
+	Size nGridSteps = grid.size() - 1;
+	Size nThreads = simulation.nThreads;
+	BigNatural masterSeed = simulation.masterSeed;
+
+	// the quasi-random samples are split evenly across the scrambles,
+	// each one being a full run over the first nSamples/scrambles points
+	Size replicates = settings.quasiRandom ? std::max<Size>(settings.scrambles, 1) : 1;
+	QL_REQUIRE(nSamples % replicates == 0,
+		"the number of samples must be a multiple of the scrambles");
+	Size replicateSamples = nSamples / replicates;
+	std::vector<std::vector<Real> > replicateSums(nThreads,
+		std::vector<Real>(replicates * nFrequencies, 0.0));
+
+	// the statistics accumulators of each worker get room for all its
+	// samples, so that filling them does not reallocate inside the sample loop
+	std::vector<std::vector<Statistics> > accumulators(nThreads,
+		std::vector<Statistics>(nFrequencies));
+	for (Size i = 0; i < nThreads; i++)
+		for (Size f = 0; f < nFrequencies; f++)
+			accumulators[i][f].reserve(replicates * workerSamples(replicateSamples, nThreads, i));
+
+	// each worker simulates its share of the nSamples paths;
+	// the buffers are allocated before its sample loop, which then runs
+	// without any heap allocation
+	runOnThreads(nThreads, [&](Size i) {
+		Size samples = replicates * workerSamples(replicateSamples, nThreads, i);
+		if (samples == 0)
+			return;
+		Simulation::generator_type& pathGenerator = *simulation.pathGenerators[i];
+		const ReplicationPathPricer& pathPricer = *simulation.pathPricers[i];
+
+		if (settings.batchSize == 0) {
+			// one path at a time through the scalar pricer, each frequency
+			// hedging the spots at its own times
+			std::vector<Real> hedgePath(nGridSteps + 1);
+			Size allocations = allocationCount();
+			for (Size s = 0; s < samples; s++) {
+				const Path& path = pathGenerator.next().value;
+				for (Size f = 0; f < nFrequencies; f++) {
+					const Real* spots = path.begin();
+					if (!wholeGrid[f]) {
+						const std::vector<Size>& indices = hedgeIndices[f];
+						for (Size k = 0; k < indices.size(); k++)
+							hedgePath[k] = path[indices[k]];
+						spots = &hedgePath[0];
+					}
+					accumulators[i][f].add(pathPricer.hedge(spots, 1, schedules[f]));
+				}
+			}
+			countLoopAllocations(allocationCount() - allocations);
+			return;
+		}
+
+		// The paths of a batch are drawn in the same order as above and
+		// laid out time-major, then hedged together at each frequency
+		Size batchSize = std::min(settings.batchSize, samples);
+		PathArena arena(settings.pathKernel ? nGridSteps : 0, nGridSteps + 1, batchSize);
+		std::vector<Real>& paths = arena.spots;
+		std::vector<Real> hedgePaths((nGridSteps + 1) * batchSize);
+		std::vector<Real> moneyAccounts(batchSize), stockAmounts(batchSize);
+
+		// hedges count paths, evolved by the kernel from the given draws
+		// or taken from the path generator, and adds up their P&L in sums
+		auto hedgePathBatches = [&](auto& draws, Size count, Real* sums) {
+			Size allocations = allocationCount();
+			for (Size done = 0; done < count; done += batchSize) {
+				Size n = std::min(batchSize, count - done);
+				if (settings.pathKernel) {
+					// the draws of a path become a column of the block
+					arena.draw(draws, n);
+					simulation.pathKernels[i]->evolve(&arena.normals[0], n, &paths[0], &arena.workspace[0]);
+				}
+				else {
+					for (Size p = 0; p < n; p++) {
+						const Path& path = pathGenerator.next().value;
+						for (Size k = 0; k <= nGridSteps; k++)
+							paths[k*n + p] = path[k];
+					}
+				}
+				for (Size f = 0; f < nFrequencies; f++) {
+					const Real* spots = &paths[0];
+					if (!wholeGrid[f]) {
+						// the rows of the hedge times, copied contiguously
+						const std::vector<Size>& indices = hedgeIndices[f];
+						for (Size k = 0; k < indices.size(); k++)
+							std::copy(paths.begin() + indices[k] * n,
+								paths.begin() + (indices[k] + 1) * n,
+								hedgePaths.begin() + k * n);
+						spots = &hedgePaths[0];
+					}
+					pathPricer.hedgeBatch(spots, n, schedules[f],
+						&moneyAccounts[0], &stockAmounts[0]);
+					for (Size p = 0; p < n; p++) {
+						accumulators[i][f].add(moneyAccounts[p]);
+						sums[f] += moneyAccounts[p];
+					}
+				}
+			}
+			countLoopAllocations(allocationCount() - allocations);
+		};
+
+		if (!settings.quasiRandom) {
+			hedgePathBatches(simulation.sequenceGenerators[i], samples, &replicateSums[i][0]);
+			return;
+		}
+
+		// in each scramble the worker takes its slice of the Sobol points,
+		// the slices of the workers following each other
+		Size count = workerSamples(replicateSamples, nThreads, i);
+		Size first = i * (replicateSamples / nThreads) + std::min(i, replicateSamples % nThreads);
+		for (Size r = 0; r < replicates; r++) {
+			SobolBridgeRsg draws(1, grid, settings.scrambles > 0 ? streamSeed(masterSeed, r) : 0,
+				settings.brownianBridge);
+			draws.skipTo(first);
+			hedgePathBatches(draws, count, &replicateSums[i][r*nFrequencies]);
+		}
+	});
+
+	// the statistics accumulators for the path-dependant Profit&Loss values,
+	// one per frequency, filled with the workers' samples in worker order
+	std::vector<Statistics> statistics(nFrequencies);
+	for (Size f = 0; f < nFrequencies; f++)
+		for (Size i = 0; i < nThreads; i++)
+			mergeStatistics(statistics[f], accumulators[i][f]);
+
+	// the randomised-QMC error of the mean P&L, from the spread of the
+	// means of the independent scrambles
+	meanErrors.clear();
+	if (settings.quasiRandom && settings.scrambles > 1) {
+		for (Size f = 0; f < nFrequencies; f++) {
+			Statistics replicateMeans;
+			for (Size r = 0; r < replicates; r++) {
+				Real sum = 0.0;
+				for (Size i = 0; i < nThreads; i++)
+					sum += replicateSums[i][r*nFrequencies + f];
+				replicateMeans.add(sum / replicateSamples);
+			}
+			meanErrors.push_back(replicateMeans.errorEstimate());
+		}
+	}
+	return statistics;
+}
+
+// One row of the Derman and Kamal table
+void ReplicationError::printRow(Size nSamples, Size nTimeSteps,
+								const Statistics& statisticsAccumulator) const
+{
+	// statisticsAccumulator gives access to the moments of the distribution
+	Real PLMean = statisticsAccumulator.mean();
+	Real PLStDev = statisticsAccumulator.standardDeviation();
+	Real PLSkew = statisticsAccumulator.skewness();
+	Real PLKurt = statisticsAccumulator.kurtosis();
 
 	// Derman and Kamal's formula
-	//Real theorStD = std::sqrt(M_PI / 4 / nTimeSteps)*vega_*std::sqrt(pricersigma->blackVariance(maturity_, strike_) / maturity_);
-	Real theorStD = std::sqrt(M_PI / 4 / nTimeSteps)*vega_*sigma_;
+	Real theorStD = dermanKamalStdDev(nTimeSteps);
 
 	std::cout << std::fixed
 		<< std::setw(8) << nSamples << " | "
@@ -131,3 +620,22 @@ void ReplicationError::compute(Size nTimeSteps, Size nSamples)
 		<< std::setw(8) << std::setprecision(2) << PLKurt << std::endl;
 }
 
+Real ReplicationError::dermanKamalStdDev(Size nTimeSteps) const
+{
+	//return std::sqrt(M_PI / 4 / nTimeSteps)*vega_*std::sqrt(pricersigma->blackVariance(maturity_, strike_) / maturity_);
+	return std::sqrt(M_PI / 4 / nTimeSteps)*vega_*sigma_;
+}
+
+// The randomised-QMC errors of the P&L means, below the table rows
+void ReplicationError::printMeanErrors(const std::vector<Size>& hedgesNums,
+									   const ReplicationSettings& settings,
+									   const std::vector<Real>& meanErrors) const
+{
+	if (meanErrors.empty())
+		return;
+	std::cout << "RQMC error of the P&L mean over " << settings.scrambles << " scrambles:";
+	for (Size f = 0; f < meanErrors.size(); f++)
+		std::cout << " " << std::setprecision(4) << meanErrors[f]
+			<< " (" << hedgesNums[f] << " trades)";
+	std::cout << std::endl;
+}
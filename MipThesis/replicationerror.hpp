@@ -4,9 +4,42 @@
 #define replication_error_hpp
 
 #include <ql/quantlib.hpp>
+#include <blackdelta.hpp>
+#include <flatvariancesurface.hpp>
 
 using namespace QuantLib;
 
+// Monte Carlo settings of a replication error run;
+// the defaults reproduce the original serial simulation
+struct ReplicationSettings {
+	ReplicationSettings() : nThreads(1), seed(0), deltaMethod(ClosedFormDelta), batchSize(0),
+		pathKernel(false), quasiRandom(false), scrambles(0), brownianBridge(true) {}
+
+	// worker threads the samples are split across (0 = all the cores)
+	Size nThreads;
+	// master seed the worker streams are derived from (0 = random);
+	// for a given seed the results only depend on nThreads
+	BigNatural seed;
+	// hedge ratio computation; ReferenceDelta runs QuantLib's
+	// BlackCalculator to check the P&L statistics of the inline kernels
+	DeltaMethod deltaMethod;
+	// paths hedged together by the batched pricer, stored time-major;
+	// 0 prices one Path at a time with the scalar pricer, the reference
+	Size batchSize;
+	// evolve the batches with the vectorised PathKernel instead of
+	// QuantLib's path generator (needs batchSize > 0)
+	bool pathKernel;
+	// draw from a Sobol sequence instead of the Mersenne Twister
+	// (needs the path kernel)
+	bool quasiRandom;
+	// independent Owen scrambles of the Sobol sequence, each one pricing
+	// nSamples/scrambles paths; their spread gives the randomised-QMC
+	// error (0 = plain Sobol sequence, no error estimate)
+	Size scrambles;
+	// build the quasi-random paths with a Brownian bridge
+	bool brownianBridge;
+};
+
 /* The ReplicationError class carries out Monte Carlo simulations to evaluate
 the outcome (the replication error) of the discrete hedging strategy over
 different, randomly generated scenarios of future stock price evolution.
@@ -20,12 +53,61 @@ class ReplicationError {
 			boost::shared_ptr<Quote> s0,
 			//boost::shared_ptr<BlackVarianceSurface> varTS,
 			Volatility vol,
-			boost::shared_ptr<YieldTermStructure> OISTermStructure);
+			boost::shared_ptr<YieldTermStructure> OISTermStructure,
+			bool verbose = true);
 
 		// the actual replication error computation
-		void compute(Size nTimeSteps, Size nSamples);
+		void compute(Size nTimeSteps, Size nSamples,
+			const ReplicationSettings& settings = ReplicationSettings());
+		// the same computation for several numbers of hedges, over
+		// common paths: one table row per entry of hedgesNums
+		void sweep(const std::vector<Size>& hedgesNums, Size nSamples,
+			const ReplicationSettings& settings = ReplicationSettings());
+		// the computation of nTimeSteps hedges in batches of batchSize
+		// paths, added until the standard error of the mean P&L is below
+		// absErr or maxSamples paths are reached; a convergence trace is
+		// printed along the way
+		void computeToTolerance(Real absErr, Size maxSamples, Size batchSize, Size nTimeSteps,
+			const ReplicationSettings& settings = ReplicationSettings());
+		// adjoint (AAD) sensitivities of the mean P&L of nTimeSteps hedges
+		// to the spot and the volatility, to the nodes of the surface the
+		// volatility is read on, through its interpolation, and, by the
+		// chain rule, to the OIS quotes of the curve
+		void computeSensitivities(Size nTimeSteps, Size nSamples,
+			const std::vector<boost::shared_ptr<SimpleQuote> >& OISQuotes,
+			const FlatBlackVarianceSurface& volatilitySurface,
+			const ReplicationSettings& settings = ReplicationSettings());
+
+		// the P&L distributions behind sweep(), one per entry of
+		// hedgesNums, without printing them
+		std::vector<Statistics> distributions(const std::vector<Size>& hedgesNums,
+			Size nSamples, const ReplicationSettings& settings = ReplicationSettings());
+		// Derman and Kamal's standard deviation of the P&L of nTimeSteps hedges
+		Real dermanKamalStdDev(Size nTimeSteps) const;
+
+		// the grid, schedules, processes, generators, kernels and pricers
+		// of a simulation, built once by prepare() on the calling thread
+		// and run any number of times
+		struct Simulation;
+		boost::shared_ptr<Simulation> prepare(const std::vector<Size>& hedgesNums,
+			Size nSamples, const ReplicationSettings& settings) const;
+		// the distributions of nSamples more paths of a prepared simulation;
+		// only the objects built by prepare() are used, so that they can be
+		// drawn on another thread than the one that prepared it
+		std::vector<Statistics> distributions(Simulation& simulation, Size nSamples) const;
 
 	private:
+		std::vector<Statistics> run(Simulation& simulation, Size nSamples,
+			std::vector<Real>& meanErrors) const;
+		std::vector<Statistics> simulate(const std::vector<Size>& hedgesNums,
+			Size nSamples, const ReplicationSettings& settings,
+			std::vector<Real>& meanErrors);
+		void printRow(Size nSamples, Size nTimeSteps,
+			const Statistics& statisticsAccumulator) const;
+		void printMeanErrors(const std::vector<Size>& hedgesNums,
+			const ReplicationSettings& settings,
+			const std::vector<Real>& meanErrors) const;
+
 		Time maturity_;
 		PlainVanillaPayoff payoff_;
 		Real strike_;
@@ -1,5 +1,6 @@
 #include <ql/quantlib.hpp>
 #include <replicationpathpricer.hpp>
+#include <hedgingschedule.hpp>
 
 using namespace QuantLib;
 
@@ -8,107 +9,141 @@ ReplicationPathPricer::ReplicationPathPricer(Option::Type type,
 											 Real strike,
 											 boost::shared_ptr<YieldTermStructure> OISTermStructure,
 											 Time maturity,
-											 Volatility vol)
+											 Volatility vol,
 											 //boost::shared_ptr<BlackVarianceSurface> varTS)
-	: type_(type), strike_(strike), OISTermStructure_(OISTermStructure), maturity_(maturity), sigma_(vol) {
+											 Size nTimeSteps,
+											 DeltaMethod deltaMethod)
+	: type_(type), strike_(strike), maturity_(maturity),
+	  deltaMethod_(deltaMethod), payoff_(new PlainVanillaPayoff(type, strike)),
+	  schedule_(OISTermStructure, maturity, vol, nTimeSteps) {
 	QL_REQUIRE(strike_ > 0.0, "strike must be positive");
 	QL_REQUIRE(maturity_ > 0.0, "maturity must be positive");
 }
 
-/* The actual computation of the Profit&Loss for each single path.
+ReplicationPathPricer::ReplicationPathPricer(Option::Type type,
+											 Real strike,
+											 Time maturity,
+											 DeltaMethod deltaMethod)
+	: type_(type), strike_(strike), maturity_(maturity),
+	  deltaMethod_(deltaMethod), payoff_(new PlainVanillaPayoff(type, strike)) {
+	QL_REQUIRE(strike_ > 0.0, "strike must be positive");
+	QL_REQUIRE(maturity_ > 0.0, "maturity must be positive");
+}
 
-In each scenario N rehedging trades spaced evenly in time over
-the life of the option are carried out, using the Black-Scholes
-hedge ratio.
-*/
 Real ReplicationPathPricer::operator()(const Path& path) const {
 
 	Size n = path.length() - 1;
 	QL_REQUIRE(n>0, "the path cannot be empty");
+	QL_REQUIRE(schedule_.size() > 0, "the pricer has no hedging schedule of its own");
+	QL_REQUIRE(n == schedule_.size(), "the path has " << n
+		<< " steps, the hedging schedule " << schedule_.size());
 
-	// discrete hedging interval
-	Time dt = maturity_ / n;
-
-	// For simplicity, we assume the stock pays no dividends.
-	Rate stockDividendYield = 0.0;
-
-	// let's start
-	Time t = 0;
-
-	// stock value at t=0
-	Real stock = path.front();
+	return hedge(path.begin(), 1, schedule_);
+}
 
-	// money account at t=0
-	Real money_account = 0.0;
+// The hedging strategy along the spots path[k*stride]*scale, k = 0..n,
+// n being the number of hedges in the schedule
+Real ReplicationPathPricer::hedge(const Real* path, Size stride,
+								  const HedgingSchedule& schedule, Real scale) const {
+	return hedge<Real>(path, stride, schedule.size(), &schedule.accrualFactors[0],
+		&schedule.rDiscounts[0], &schedule.stdDevs[0], scale);
+}
 
-	/************************/
-	/*** the initial deal ***/
-	/************************/
-	// option fair price (Black-Scholes) at t=0	
+/* The batched version of hedge(). The recurrence is the same; the loop
+over the paths is the inner one, so that at every hedge the money
+accounts, the stock amounts and the deltas are computed over contiguous
+arrays without any dependency between the paths.
+*/
+void ReplicationPathPricer::hedgeBatch(const Real* paths, Size nPaths,
+									   const HedgingSchedule& schedule,
+									   Real* moneyAccounts, Real* stockAmounts) const {
 
-	DiscountFactor rDiscount = OISTermStructure_->discount(maturity_);
+	Size n = schedule.size();
 	DiscountFactor qDiscount = 1.0;
-	Real forward = stock*qDiscount/rDiscount;
-	Real stdDev = std::sqrt(sigma_*sigma_*maturity_);
-	//Real stdDev = std::sqrt(sigma_->blackVariance(maturity_, strike_));
-	boost::shared_ptr<StrikedTypePayoff> payoff(new PlainVanillaPayoff(type_, strike_));
-	BlackCalculator black(payoff, forward, stdDev, rDiscount);
-	
-	// sell the option, cash in its premium
-	money_account += black.value();
-	// compute delta
-	Real delta = black.delta(stock);
-	// delta-hedge the option buying stock
-	Real stockAmount = delta;
-	money_account -= stockAmount*stock;
-
-	/**********************************/
-	/*** hedging during option life ***/
-	/**********************************/
-	for (Size step = 0; step < n - 1; step++) {
-
-		// time flows
-		t += dt;
-
-		// accruing on the money account
-		money_account *= (1.00 /((OISTermStructure_->discount(t)) / (OISTermStructure_->discount(t - dt))));
-
-		// stock growth:
-		stock = path[step + 1];
-
-		// recalculate option value at the current stock value,
-		// and the current time to maturity
-
-		rDiscount = (OISTermStructure_->discount(maturity_)) / (OISTermStructure_->discount(t));
-		forward = stock*qDiscount / rDiscount;
-		stdDev = std::sqrt(sigma_*sigma_*(maturity_ - t));
-		//BlackCalculator black(payoff, forward, std::sqrt(sigma_->blackForwardVariance(t, maturity_, strike_)), rDiscount);
-		BlackCalculator black(payoff, forward, stdDev, rDiscount);
-
-		// recalculate delta
-		delta = black.delta(stock);
-
-		// re-hedging
-		money_account -= (delta - stockAmount)*stock;
-		stockAmount = delta;
+
+	// the initial deal: sell the option and delta-hedge it
+	DiscountFactor rDiscount = schedule.rDiscounts[0];
+	Real stdDev = schedule.stdDevs[0];
+	for (Size p = 0; p < nPaths; p++) {
+		Real stock = paths[p];
+		Real forward = stock*qDiscount / rDiscount;
+		Real delta = hedgeRatio(stock, forward, stdDev, rDiscount, qDiscount);
+		moneyAccounts[p] = optionValue(forward, stdDev, rDiscount) - delta*stock;
+		stockAmounts[p] = delta;
 	}
 
-	/*************************/
-	/*** option expiration ***/
-	/*************************/
-	// last accrual on my money account
-	money_account *= (1.00 / ((OISTermStructure_->discount(t)) / (OISTermStructure_->discount(t - dt))));
+	// hedging during option life
+	for (Size step = 1; step < n; step++) {
+		const Real* spots = paths + step*nPaths;
+		Real accrual = schedule.accrualFactors[step - 1];
+		rDiscount = schedule.rDiscounts[step];
+		stdDev = schedule.stdDevs[step];
+
+		if (deltaMethod_ == ReferenceDelta || stdDev <= 0.0) {
+			// the reference calculator (or the intrinsic delta of a null
+			// deviation), one path at a time
+			for (Size p = 0; p < nPaths; p++) {
+				Real stock = spots[p];
+				Real delta = hedgeRatio(stock, stock*qDiscount / rDiscount, stdDev, rDiscount, qDiscount);
+				moneyAccounts[p] = moneyAccounts[p] * accrual - (delta - stockAmounts[p])*stock;
+				stockAmounts[p] = delta;
+			}
+		}
+		else if (deltaMethod_ == FastDelta) {
+			rebalance<true>(spots, nPaths, accrual, rDiscount, stdDev, moneyAccounts, stockAmounts);
+		}
+		else {
+			rebalance<false>(spots, nPaths, accrual, rDiscount, stdDev, moneyAccounts, stockAmounts);
+		}
+	}
 
-	// last stock growth
-	stock = path[n];
+	// option expiration: last accrual, payoff delivery and hedge unwinding
+	const Real* spots = paths + n*nPaths;
+	Real accrual = schedule.accrualFactors[n - 1];
+	for (Size p = 0; p < nPaths; p++) {
+		Real stock = spots[p];
+		Real intrinsic = (type_ == Option::Call) ? stock - strike_ : strike_ - stock;
+		moneyAccounts[p] = moneyAccounts[p] * accrual
+			- std::max<Real>(intrinsic, 0.0) + stockAmounts[p] * stock;
+	}
+}
 
-	// the hedger delivers the option payoff to the option holder
-	Real optionPayoff = PlainVanillaPayoff(type_, strike_)(stock);
-	money_account -= optionPayoff;
+// At a given hedge d1 = (log(S) + log(q/(r*K)))/stdDev + stdDev/2, the
+// deterministic part being the same for all the paths: it is hoisted out of
+// the loop, which is left with a log, a normal CDF and a few products.
+template <bool fast>
+void ReplicationPathPricer::rebalance(const Real* spots, Size nPaths, Real accrual,
+									  DiscountFactor rDiscount, Real stdDev,
+									  Real* moneyAccounts, Real* stockAmounts) const {
+	DiscountFactor qDiscount = 1.0;
+	Real shift = std::log(qDiscount / (rDiscount*strike_));
+	Real invStdDev = 1.0 / stdDev;
+	Real halfStdDev = 0.5 * stdDev;
+	Real putShift = (type_ == Option::Call) ? 0.0 : -1.0;
+
+	for (Size p = 0; p < nPaths; p++) {
+		Real stock = spots[p];
+		Real d1 = (std::log(stock) + shift) * invStdDev + halfStdDev;
+		Real nd1 = fast ? fastNormalCdf(d1) : normalCdf(d1);
+		Real delta = qDiscount * (nd1 + putShift);
+		moneyAccounts[p] = moneyAccounts[p] * accrual - (delta - stockAmounts[p])*stock;
+		stockAmounts[p] = delta;
+	}
+}
 
-	// and unwinds the hedge selling his stock position
-	money_account += stockAmount*stock;
+template <>
+Real ReplicationPathPricer::optionValue<Real>(const Real& forward, const Real& stdDev,
+											  const Real& rDiscount) const {
+	if (deltaMethod_ == ReferenceDelta)
+		return BlackCalculator(payoff_, forward, stdDev, rDiscount).value();
+	return blackValue(type_, forward, strike_, stdDev, rDiscount, deltaMethod_ == FastDelta);
+}
 
-	// final Profit&Loss
-	return money_account;
-}
\ No newline at end of file
+template <>
+Real ReplicationPathPricer::hedgeRatio<Real>(const Real& stock, const Real& forward,
+											 const Real& stdDev, const Real& rDiscount,
+											 DiscountFactor qDiscount) const {
+	if (deltaMethod_ == ReferenceDelta)
+		return BlackCalculator(payoff_, forward, stdDev, rDiscount).delta(stock);
+	return blackDelta(type_, forward, strike_, stdDev, qDiscount, deltaMethod_ == FastDelta);
+}
@@ -4,6 +4,8 @@
 #define replication_path_pricer_hpp
 
 #include <ql/quantlib.hpp>
+#include <blackdelta.hpp>
+#include <hedgingschedule.hpp>
 
 using namespace QuantLib;
 
@@ -17,20 +19,168 @@ class ReplicationPathPricer : public PathPricer<Path> {
 			Real strike,
 			boost::shared_ptr<YieldTermStructure> OISTermStructure,
 			Time maturity,
-			Volatility vol);
+			Volatility vol,
 			//boost::shared_ptr<BlackVarianceSurface> varTS);
+			Size nTimeSteps,
+			DeltaMethod deltaMethod = ClosedFormDelta);
+		// a pricer without a schedule of its own, for callers passing their
+		// schedules to hedge() and hedgeBatch(); it cannot price a Path
+		ReplicationPathPricer(Option::Type type,
+			Real strike,
+			Time maturity,
+			DeltaMethod deltaMethod = ClosedFormDelta);
 
 		// The value() method encapsulates the pricing code
 		Real operator()(const Path& path) const;
 
+		// the Profit&Loss of the strategy hedging along the spots
+		// path[k*stride]*scale at the times of the given schedule; the path
+		// is read in place, e.g. a window of a historical series
+		Real hedge(const Real* path, Size stride, const HedgingSchedule& schedule,
+			Real scale = 1.0) const;
+
+		/* The same strategy on any number type, the Numbers of the adjoint
+		mode in particular. The accruals, discount factors and standard
+		deviations of the n hedges are taken as arguments instead of a
+		schedule's, so that their derivatives are recorded as well; on
+		types other than Real the option is valued in closed form with the
+		exact normal CDF, whatever the delta method. */
+		template <class T>
+		T hedge(const T* path, Size stride, Size n, const T* accrualFactors,
+			const T* rDiscounts, const T* stdDevs, Real scale = 1.0) const;
+
+		// The same strategy run on nPaths paths at once. The paths are stored
+		// time-major (the spot of path p at step k is paths[k*nPaths + p]) and
+		// each hedge advances the money accounts and the stock amounts of all
+		// of them as contiguous arrays, a loop the compiler can vectorise.
+		// On return moneyAccounts holds the P&Ls; both arrays have nPaths slots.
+		void hedgeBatch(const Real* paths, Size nPaths, const HedgingSchedule& schedule,
+			Real* moneyAccounts, Real* stockAmounts) const;
+
+		const HedgingSchedule& schedule() const { return schedule_; }
+
 	private:
+		// the option's value and hedge ratio at a rebalancing
+		template <class T>
+		T optionValue(const T& forward, const T& stdDev, const T& rDiscount) const;
+		template <class T>
+		T hedgeRatio(const T& stock, const T& forward, const T& stdDev,
+			const T& rDiscount, DiscountFactor qDiscount) const;
+		// one rebalancing of all the paths of a batch
+		template <bool fast>
+		void rebalance(const Real* spots, Size nPaths, Real accrual,
+			DiscountFactor rDiscount, Real stdDev,
+			Real* moneyAccounts, Real* stockAmounts) const;
+
 		Option::Type type_;
 		Real strike_;
-		boost::shared_ptr<YieldTermStructure> OISTermStructure_;
 		Time maturity_;
-		//boost::shared_ptr<BlackVarianceSurface> sigma_;
-		Volatility sigma_;
+		DeltaMethod deltaMethod_;
+		// payoff of the reference BlackCalculator, built once
+		boost::shared_ptr<StrikedTypePayoff> payoff_;
+		// accruals, discounts and deviations of the nTimeSteps hedges
+		HedgingSchedule schedule_;
 };
 
 
+// the Real versions follow the delta method
+template <>
+Real ReplicationPathPricer::optionValue<Real>(const Real& forward, const Real& stdDev,
+	const Real& rDiscount) const;
+template <>
+Real ReplicationPathPricer::hedgeRatio<Real>(const Real& stock, const Real& forward,
+	const Real& stdDev, const Real& rDiscount, DiscountFactor qDiscount) const;
+
+template <class T>
+T ReplicationPathPricer::optionValue(const T& forward, const T& stdDev, const T& rDiscount) const {
+	T d1 = log(forward / strike_) / stdDev + 0.5 * stdDev;
+	T nd1 = normalCdf(d1);
+	T nd2 = normalCdf(d1 - stdDev);
+	if (type_ == Option::Call)
+		return rDiscount * (forward * nd1 - strike_ * nd2);
+	return rDiscount * (strike_ * (1.0 - nd2) - forward * (1.0 - nd1));
+}
+
+template <class T>
+T ReplicationPathPricer::hedgeRatio(const T& stock, const T& forward, const T& stdDev,
+	const T& rDiscount, DiscountFactor qDiscount) const {
+	T nd1 = normalCdf(log(forward / strike_) / stdDev + 0.5 * stdDev);
+	return qDiscount * (type_ == Option::Call ? nd1 : nd1 - 1.0);
+}
+
+/* The actual computation of the Profit&Loss for each single path.
+
+In each scenario N rehedging trades spaced evenly in time over
+the life of the option are carried out, using the Black-Scholes
+hedge ratio.
+*/
+template <class T>
+T ReplicationPathPricer::hedge(const T* path, Size stride, Size n, const T* accrualFactors,
+	const T* rDiscounts, const T* stdDevs, Real scale) const {
+
+	using std::max;
+
+	// For simplicity, we assume the stock pays no dividends.
+	DiscountFactor qDiscount = 1.0;
+
+	// stock value at t=0
+	T stock = path[0]*scale;
+
+	/************************/
+	/*** the initial deal ***/
+	/************************/
+	// option fair price (Black-Scholes) at t=0
+	T forward = stock*qDiscount/rDiscounts[0];
+
+	// sell the option, cash in its premium
+	T money_account = optionValue(forward, stdDevs[0], rDiscounts[0]);
+	// compute delta
+	T delta = hedgeRatio(stock, forward, stdDevs[0], rDiscounts[0], qDiscount);
+	// delta-hedge the option buying stock
+	T stockAmount = delta;
+	money_account -= stockAmount*stock;
+
+	/**********************************/
+	/*** hedging during option life ***/
+	/**********************************/
+	for (Size step = 1; step < n; step++) {
+
+		// accruing on the money account
+		money_account *= accrualFactors[step - 1];
+
+		// stock growth:
+		stock = path[step*stride]*scale;
+
+		// recalculate option value at the current stock value,
+		// and the current time to maturity
+		forward = stock*qDiscount / rDiscounts[step];
+
+		// recalculate delta
+		delta = hedgeRatio(stock, forward, stdDevs[step], rDiscounts[step], qDiscount);
+
+		// re-hedging
+		money_account -= (delta - stockAmount)*stock;
+		stockAmount = delta;
+	}
+
+	/*************************/
+	/*** option expiration ***/
+	/*************************/
+	// last accrual on my money account
+	money_account *= accrualFactors[n - 1];
+
+	// last stock growth
+	stock = path[n*stride]*scale;
+
+	// the hedger delivers the option payoff to the option holder
+	T intrinsic = (type_ == Option::Call) ? stock - strike_ : strike_ - stock;
+	money_account -= max(intrinsic, 0.0);
+
+	// and unwinds the hedge selling his stock position
+	money_account += stockAmount*stock;
+
+	// final Profit&Loss
+	return money_account;
+}
+
 #endif // !replication_path_pricer_h
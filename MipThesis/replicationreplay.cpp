@@ -0,0 +1,117 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <ql/quantlib.hpp>
+#include <replicationreplay.hpp>
+#include <replicationpathpricer.hpp>
+#include <parallelmontecarlo.hpp>
+
+using namespace QuantLib;
+
+ReplicationReplay::ReplicationReplay(const PriceHistory& history,
+									 Option::Type type,
+									 Real moneyness,
+									 Size windowTicks,
+									 boost::shared_ptr<YieldTermStructure> OISTermStructure,
+									 Volatility vol)
+	: history_(history), type_(type), moneyness_(moneyness), windowTicks_(windowTicks),
+	maturity_(windowTicks / history.ticksPerYear()), OISTermStructure_(OISTermStructure), sigma_(vol) {
+
+	QL_REQUIRE(moneyness_ > 0.0, "the moneyness must be positive");
+	QL_REQUIRE(windowTicks_ > 0, "the window must be at least one tick long");
+	QL_REQUIRE(windowTicks_ < history_.size(), "window of " << windowTicks_
+		<< " ticks, longer than the history of " << history_.size() - 1);
+
+	// value of the option on a unit spot
+	DiscountFactor rDiscount = OISTermStructure_->discount(maturity_);
+	boost::shared_ptr<StrikedTypePayoff> payoff(new PlainVanillaPayoff(type_, moneyness_));
+	BlackCalculator black(payoff, 1.0 / rDiscount, sigma_ * std::sqrt(maturity_), rDiscount);
+	vega_ = black.vega(maturity_);
+}
+
+Size ReplicationReplay::windows(Size windowStep) const {
+	QL_REQUIRE(windowStep > 0, "the windows must be at least one tick apart");
+	return (history_.size() - 1 - windowTicks_) / windowStep + 1;
+}
+
+void ReplicationReplay::compute(const std::vector<Size>& strides, Size windowStep,
+								const ReplicationSettings& settings,
+								const std::string& fileName) const
+{
+	QL_REQUIRE(!strides.empty(), "no rebalancing stride given");
+	Size nStrides = strides.size();
+	Size nWindows = windows(windowStep);
+
+	// one pricer and schedule per stride, read by all the workers
+	std::vector<boost::shared_ptr<ReplicationPathPricer> > pricers;
+	std::vector<Size> hedgesNums;
+	for (Size f = 0; f < nStrides; f++) {
+		QL_REQUIRE(strides[f] > 0 && windowTicks_ % strides[f] == 0,
+			"stride of " << strides[f] << " ticks, not dividing the window of " << windowTicks_);
+		hedgesNums.push_back(windowTicks_ / strides[f]);
+		pricers.push_back(boost::shared_ptr<ReplicationPathPricer>(
+			new ReplicationPathPricer(type_, moneyness_, OISTermStructure_, maturity_,
+				sigma_, hedgesNums[f], settings.deltaMethod)));
+	}
+
+	// the P&Ls of each stride, window by window
+	std::vector<Real> PLs(nStrides * nWindows);
+	const Real* prices = history_.begin();
+
+	Size blockSize = 4096;
+	Size nBlocks = (nWindows + blockSize - 1) / blockSize;
+	Size nThreads = settings.nThreads > 0 ? settings.nThreads : defaultThreads();
+	nThreads = std::min(nThreads, nBlocks);
+
+	runBatches(nBlocks, nThreads, [&](Size block, Size) {
+		Size last = std::min(nWindows, (block + 1) * blockSize);
+		for (Size w = block * blockSize; w < last; w++) {
+			const Real* window = prices + w * windowStep;
+			Real scale = 1.0 / window[0];
+			for (Size f = 0; f < nStrides; f++)
+				PLs[f * nWindows + w] = pricers[f]->hedge(window, strides[f], pricers[f]->schedule(), scale);
+		}
+	});
+
+	std::cout << "Replay on " << nWindows << " windows of " << windowTicks_ << " ticks ("
+		<< std::setprecision(4) << maturity_ << " years), P&L per unit of initial spot" << std::endl;
+	std::cout << std::setw(8) << "windows" << " | "
+		<< std::setw(8) << "trades" << " | "
+		<< std::setw(8) << "mean" << " | "
+		<< std::setw(8) << "std.dev." << " | "
+		<< std::setw(12) << "Derman&Kamal" << " | "
+		<< std::setw(8) << "skewness" << " | "
+		<< std::setw(8) << "kurtosis" << std::endl;
+	std::cout << std::string(78, '-') << std::endl;
+
+	for (Size f = 0; f < nStrides; f++) {
+		IncrementalStatistics statistics;
+		statistics.addSequence(PLs.begin() + f * nWindows, PLs.begin() + (f + 1) * nWindows);
+		Real theorStD = std::sqrt(M_PI / 4 / hedgesNums[f])*vega_*sigma_;
+		std::cout << std::fixed
+			<< std::setw(8) << nWindows << " | "
+			<< std::setw(8) << hedgesNums[f] << " | "
+			<< std::setw(8) << std::setprecision(4) << statistics.mean() << " | "
+			<< std::setw(8) << std::setprecision(4) << statistics.standardDeviation() << " | "
+			<< std::setw(12) << std::setprecision(4) << theorStD << " | "
+			<< std::setw(8) << std::setprecision(2) << statistics.skewness() << " | "
+			<< std::setw(8) << std::setprecision(2) << statistics.kurtosis() << std::endl;
+	}
+
+	if (fileName.empty())
+		return;
+	std::ofstream out(fileName.c_str());
+	QL_REQUIRE(out, "cannot write the replay file " << fileName);
+	out.precision(10);
+	out << "tick,spot";
+	for (Size f = 0; f < nStrides; f++)
+		out << ",pl" << hedgesNums[f];
+	out << "\n";
+	for (Size w = 0; w < nWindows; w++) {
+		out << w * windowStep << "," << prices[w * windowStep];
+		for (Size f = 0; f < nStrides; f++)
+			out << "," << PLs[f * nWindows + w];
+		out << "\n";
+	}
+	QL_ENSURE(out, "error writing the replay file " << fileName);
+}
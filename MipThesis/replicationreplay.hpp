@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef replication_replay_hpp
+#define replication_replay_hpp
+
+#include <ql/quantlib.hpp>
+#include <pricehistory.hpp>
+#include <replicationerror.hpp>
+#include <string>
+
+using namespace QuantLib;
+
+/* The discrete hedging strategy replayed on a historical price series
+instead of simulated paths.
+
+An option of windowTicks ticks, struck at moneyness times the spot, is
+sold at the start of each window of the series and hedged until its
+expiry; a window starts every windowStep ticks. A rebalancing frequency
+is given as the stride, in ticks, between two hedges, which must divide
+the window. The strategy of ReplicationPathPricer reads each window in
+place through the strided hedge(), on the spots divided by the first one:
+the P&Ls are per unit of initial spot, comparable across the windows,
+and no Path is built. The schedule of each stride is computed once and
+shared by all the windows.
+
+The windows are spread across the workers in blocks; each P&L has its
+own slot, so that the results do not depend on the number of threads.
+*/
+
+class ReplicationReplay {
+	public:
+		ReplicationReplay(const PriceHistory& history,
+			Option::Type type,
+			Real moneyness,
+			Size windowTicks,
+			boost::shared_ptr<YieldTermStructure> OISTermStructure,
+			Volatility vol);
+
+		// one table row per stride, as ReplicationError::sweep(); the P&L
+		// of every window is also written to fileName, if given, one line
+		// per window: its first tick, its first spot and a P&L per stride.
+		// settings.nThreads and settings.deltaMethod are used.
+		void compute(const std::vector<Size>& strides, Size windowStep,
+			const ReplicationSettings& settings = ReplicationSettings(),
+			const std::string& fileName = "") const;
+
+		// windows starting every windowStep ticks
+		Size windows(Size windowStep) const;
+
+	private:
+		PriceHistory history_;
+		Option::Type type_;
+		Real moneyness_;
+		Size windowTicks_;
+		Time maturity_;
+		boost::shared_ptr<YieldTermStructure> OISTermStructure_;
+		Volatility sigma_;
+		// vega of the option on a unit spot, for Derman and Kamal's formula
+		Real vega_;
+};
+
+#endif // !replication_replay_hpp
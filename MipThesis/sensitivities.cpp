@@ -0,0 +1,54 @@
+#include <iomanip>
+#include <iostream>
+#include <ql/quantlib.hpp>
+#include <sensitivities.hpp>
+
+using namespace QuantLib;
+
+Matrix quoteJacobian(const std::vector<boost::shared_ptr<SimpleQuote> >& quotes,
+					 const std::function<std::vector<Real>()>& quantities, Real bump) {
+
+	QL_REQUIRE(bump > 0.0, "the bump must be positive");
+
+	Size nQuantities = quantities().size();
+	Matrix jacobian(quotes.size(), nQuantities, 0.0);
+
+	for (Size i = 0; i < quotes.size(); i++) {
+		Real quote = quotes[i]->value();
+
+		// the curves observing the quote are rebuilt lazily at each read
+		quotes[i]->setValue(quote + bump);
+		std::vector<Real> up = quantities();
+		quotes[i]->setValue(quote - bump);
+		std::vector<Real> down = quantities();
+		quotes[i]->setValue(quote);
+
+		for (Size j = 0; j < nQuantities; j++)
+			jacobian[i][j] = (up[j] - down[j]) / (2.0 * bump);
+	}
+
+	return jacobian;
+}
+
+std::vector<Real> chainRule(const Matrix& jacobian, const std::vector<Real>& adjoints) {
+
+	QL_REQUIRE(jacobian.columns() == adjoints.size(),
+		adjoints.size() << " adjoints given for a Jacobian of " << jacobian.columns() << " columns");
+
+	std::vector<Real> gradient(jacobian.rows(), 0.0);
+	for (Size i = 0; i < jacobian.rows(); i++)
+		for (Size j = 0; j < jacobian.columns(); j++)
+			gradient[i] += jacobian[i][j] * adjoints[j];
+
+	return gradient;
+}
+
+void printSensitivities(const std::string& name, const std::vector<Real>& sensitivities, Real scale) {
+	for (Size i = 0; i < sensitivities.size(); i++) {
+		if (sensitivities[i] == 0.0)
+			continue;
+		std::cout << std::setw(16) << name << " " << std::setw(3) << i + 1 << " | "
+			<< std::fixed << std::setprecision(6) << std::setw(12)
+			<< sensitivities[i] * scale << std::endl;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#ifndef sensitivities_hpp
+#define sensitivities_hpp
+
+#include <ql/quantlib.hpp>
+#include <functional>
+#include <string>
+
+using namespace QuantLib;
+
+/* Market-data side of the adjoint sensitivities.
+
+The simulators differentiate their figures with respect to the few
+quantities the paths actually read (discount factors on the simulation
+grid, repayment values, the volatility). These are deterministic
+functions of the market quotes, so the sensitivities to the quotes follow
+by the chain rule from the Jacobians below, which only cost a handful of
+curve bootstraps and no simulation.
+*/
+
+// Derivatives of some quantities computed from the curves with respect to
+// the quotes the curves are built on, by central bumps of each quote: the
+// rows follow the quotes, the columns the quantities
+Matrix quoteJacobian(const std::vector<boost::shared_ptr<SimpleQuote> >& quotes,
+	const std::function<std::vector<Real>()>& quantities, Real bump);
+
+// The gradient with respect to the quotes, from the Jacobian and the
+// adjoints of the quantities
+std::vector<Real> chainRule(const Matrix& jacobian, const std::vector<Real>& adjoints);
+
+// One line per non-null sensitivity, multiplied by scale (e.g. 1.0e-4 for
+// the change per basis point)
+void printSensitivities(const std::string& name, const std::vector<Real>& sensitivities, Real scale);
+
+#endif // !sensitivities_hpp
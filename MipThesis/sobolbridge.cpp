@@ -0,0 +1,84 @@
+#include <ql/quantlib.hpp>
+#include <sobolbridge.hpp>
+#include <parallelmontecarlo.hpp>
+
+using namespace QuantLib;
+
+static inline boost::uint32_t reverseBits(boost::uint32_t x) {
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+// Nested uniform scramble of a 32-bit Sobol coordinate: on the reversed
+// bits, the Laine-Karras style hash only lets each bit be flipped by the
+// lower ones, i.e. by the higher digits of the coordinate, as Owen's
+// scramble does (Burley's constants)
+static inline boost::uint32_t owenScramble(boost::uint32_t x, boost::uint32_t seed) {
+	x = reverseBits(x);
+	x ^= x * 0x3d20adeau;
+	x += seed;
+	x *= (seed >> 16) | 1u;
+	x ^= x * 0x05526c56u;
+	x ^= x * 0x53a22864u;
+	return reverseBits(x);
+}
+
+SobolBridgeRsg::SobolBridgeRsg(Size factors, const TimeGrid& timeGrid,
+							   BigNatural scrambleSeed, bool brownianBridge)
+	: factors_(factors), steps_(timeGrid.size() - 1), dimension_(factors * (timeGrid.size() - 1)),
+	  sobol_(factors * (timeGrid.size() - 1), 0, SobolRsg::JoeKuoD7),
+	  origin_(factors * (timeGrid.size() - 1), 0), originNext_(true),
+	  brownianBridge_(brownianBridge), bridge_(timeGrid),
+	  gaussians_(dimension_), bridgeInput_(steps_), bridgeOutput_(steps_),
+	  next_(std::vector<Real>(dimension_), 1.0) {
+	QL_REQUIRE(factors_ > 0, "at least one factor is needed");
+	QL_REQUIRE(steps_ > 0, "the time grid has no steps");
+
+	// every dimension gets its own scramble
+	if (scrambleSeed != 0) {
+		dimensionSeeds_.reserve(dimension_);
+		for (Size d = 0; d < dimension_; d++)
+			dimensionSeeds_.push_back(boost::uint32_t(streamSeed(scrambleSeed, d)));
+	}
+}
+
+const SobolBridgeRsg::sample_type& SobolBridgeRsg::nextSequence() {
+
+	// the coordinates are taken at the centre of their 2^-32 cell,
+	// so that they never hit 0 where the inverse normal diverges
+	const Real normalization = 1.0 / 4294967296.0;
+	// SobolRsg starts from the point after the origin
+	const std::vector<boost::uint32_t>& point = originNext_ ? origin_ : sobol_.nextInt32Sequence();
+	originNext_ = false;
+	for (Size d = 0; d < dimension_; d++) {
+		boost::uint32_t x = dimensionSeeds_.empty() ? point[d] : owenScramble(point[d], dimensionSeeds_[d]);
+		gaussians_[d] = inverseNormal_((x + 0.5) * normalization);
+	}
+
+	std::vector<Real>& draws = next_.value;
+	if (!brownianBridge_) {
+		std::copy(gaussians_.begin(), gaussians_.end(), draws.begin());
+		return next_;
+	}
+
+	// one bridge per factor, fed with every factors-th coordinate
+	for (Size f = 0; f < factors_; f++) {
+		for (Size j = 0; j < steps_; j++)
+			bridgeInput_[j] = gaussians_[j*factors_ + f];
+		bridge_.transform(bridgeInput_.begin(), bridgeInput_.end(), bridgeOutput_.begin());
+		for (Size k = 0; k < steps_; k++)
+			draws[k*factors_ + f] = bridgeOutput_[k];
+	}
+	return next_;
+}
+
+void SobolBridgeRsg::skipTo(Size n) {
+	// SobolRsg::skipTo(m) moves to its (m+1)-th point, the origin excluded
+	if (n == 0)
+		return;
+	sobol_.skipTo(boost::uint32_t(n - 1));
+	originNext_ = false;
+}
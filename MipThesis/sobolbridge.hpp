@@ -0,0 +1,59 @@
+#pragma once
+
+#ifndef sobol_bridge_hpp
+#define sobol_bridge_hpp
+
+#include <ql/quantlib.hpp>
+
+using namespace QuantLib;
+
+/* Quasi-random Gaussian draws for the path kernels.
+
+The draws come from a Sobol sequence with the Joe-Kuo D7 direction
+numbers, which cover up to 21201 dimensions (1500 steps of the 2-factor
+Heston model take 3000). Each point can be scrambled with a nested uniform
+(Owen) scramble, so that independent scrambles give independent unbiased
+estimates and a randomised-QMC error; the scramble is the hash-based one
+of Laine and Karras, with Burley's constants.
+
+With the Brownian bridge the first dimensions of the sequence, the most
+uniform ones, build the coarse shape of the paths: dimension j*factors + f
+is the j-th point of the bridge of factor f on the simulation grid.
+
+The draws of a point are laid out as PathKernel wants them for a path:
+the normalised increment of factor f over step k is value[k*factors + f].
+
+The points are counted from the origin of the sequence, which QuantLib's
+SobolRsg skips: the first 2^m points form a (t,m,s)-net, balanced over the
+dyadic boxes, and so do the 2^m points from any multiple of 2^m.
+*/
+class SobolBridgeRsg {
+	public:
+		typedef Sample<std::vector<Real> > sample_type;
+
+		// scrambleSeed = 0 gives the plain Sobol sequence
+		SobolBridgeRsg(Size factors, const TimeGrid& timeGrid,
+			BigNatural scrambleSeed, bool brownianBridge);
+
+		const sample_type& nextSequence();
+		// on a newly built generator: the next call to nextSequence()
+		// returns the n-th point, the origin being the 0-th
+		void skipTo(Size n);
+		Size dimension() const { return dimension_; }
+
+	private:
+		Size factors_, steps_, dimension_;
+		SobolRsg sobol_;
+		// the origin, returned before the points of sobol_ unless skipped
+		std::vector<boost::uint32_t> origin_;
+		bool originNext_;
+		std::vector<boost::uint32_t> dimensionSeeds_;
+		bool brownianBridge_;
+		BrownianBridge bridge_;
+		InverseCumulativeNormal inverseNormal_;
+		// the Gaussian point in sequence order, and a factor's bridge
+		std::vector<Real> gaussians_, bridgeInput_, bridgeOutput_;
+		sample_type next_;
+};
+
+#endif // !sobol_bridge_hpp